@@ -40,8 +40,11 @@ const CPP_F_FAILED = 1.5
 const CPP_T_FAIL = 0.95
 const CPP_P_MIN = 0.05
 const CPP_F_RUNUP = 1.1
+const CPP_D_THRESH = CPP_V_CITY / 375
+const CPP_F_THRESH = 1.0
+const CPP_GAMMA_THRESH = 1.01
 
-# Parse C++ output file (works for costs.txt and zones.txt)
+# Parse C++ output file (works for costs.txt, zones.txt, damage.txt and ead.txt)
 function parse_cpp_output(filename)
     data = Dict{String,Dict{String,Any}}()
     current_case = nothing
@@ -74,11 +77,17 @@ end
     output_dir = joinpath(@__DIR__, "..", "validation", "cpp_reference", "outputs")
     costs_file = joinpath(output_dir, "costs.txt")
     zones_file = joinpath(output_dir, "zones.txt")
+    damage_file = joinpath(output_dir, "damage.txt")
+    ead_file = joinpath(output_dir, "ead.txt")
     @test isfile(costs_file)
     @test isfile(zones_file)
+    @test isfile(damage_file)
+    @test isfile(ead_file)
 
     cpp_costs = parse_cpp_output(costs_file)
     cpp_zones = parse_cpp_output(zones_file)
+    cpp_damage = parse_cpp_output(damage_file)
+    cpp_ead = parse_cpp_output(ead_file)
 
     # Validation tolerance (floating-point precision)
     rtol = 1e-10
@@ -146,4 +155,76 @@ end
             end
         end
     end
+
+    @testset "Event damage" begin
+        for test_name in test_cases
+            @testset "$test_name" begin
+                levers = cpp_damage[test_name]["levers"]
+                W = levers["W"]
+                R = levers["R"]
+                P = levers["P"]
+                D = levers["D"]
+                B = levers["B"]
+                h_raw = cpp_damage[test_name]["h_surge"]
+
+                h_eff = ICOWCore.effective_surge(h_raw, CPP_H_SEAWALL, CPP_F_RUNUP)
+                @test h_eff ≈ cpp_damage[test_name]["effective_surge"] atol = 1e-12
+
+                bounds = ICOWCore.zone_boundaries(CPP_H_CITY, W, R, B, D)
+                V_w = ICOWCore.value_after_withdrawal(CPP_V_CITY, CPP_H_CITY, CPP_F_L, W)
+                values = ICOWCore.zone_values(
+                    V_w, CPP_H_CITY, W, R, B, D, CPP_R_PROT, CPP_R_UNPROT
+                )
+
+                # C++ damage_intact/damage_failed are the dvt entry of the damage vector
+                for (dike_failed, key) in ((false, "damage_intact"), (true, "damage_failed"))
+                    julia_dmg = ICOWCore.total_event_damage(
+                        bounds,
+                        values,
+                        h_eff,
+                        CPP_B_BASEMENT,
+                        CPP_H_BLDG,
+                        CPP_F_DAMAGE,
+                        P,
+                        CPP_F_INTACT,
+                        CPP_F_FAILED,
+                        CPP_D_THRESH,
+                        CPP_F_THRESH,
+                        CPP_GAMMA_THRESH,
+                        dike_failed,
+                    )
+                    @test julia_dmg ≈ cpp_damage[test_name][key] rtol = rtol atol = 1e-6
+                end
+
+                # Failure probability at the surge above the dike base W + B
+                h_at_dike = max(0.0, h_eff - (W + B))
+                julia_pf = ICOWCore.dike_failure_probability(h_at_dike, D, CPP_T_FAIL, CPP_P_MIN)
+                @test julia_pf ≈ cpp_damage[test_name]["dike_failure_probability"] rtol = rtol
+            end
+        end
+    end
+
+    @testset "Expected annual damage" begin
+        # C++ splits the integral at zone boundaries and threshold crossings; Julia does not
+        config = ICOW.EAD.EADConfig()
+        for test_name in test_cases
+            @testset "$test_name" begin
+                levers = cpp_ead[test_name]["levers"]
+                fd = FloodDefenses(levers["W"], levers["R"], levers["P"], levers["D"], levers["B"])
+                dist = GeneralizedExtremeValue(
+                    cpp_ead[test_name]["surge_loc"],
+                    cpp_ead[test_name]["surge_scale"],
+                    cpp_ead[test_name]["surge_shape"],
+                )
+                julia_ead = ICOW.EAD._integrate_expected_damage(
+                    ICOW.EAD.QuadratureIntegrator(; rtol=1e-10),
+                    config,
+                    fd,
+                    dist,
+                    Random.default_rng(),
+                )
+                @test julia_ead ≈ cpp_ead[test_name]["expected_annual_damage"] rtol = 1e-6
+            end
+        end
+    end
 end
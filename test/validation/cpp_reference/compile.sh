@@ -6,15 +6,33 @@ echo "Compiling debugged ICOW C++ reference code..."
 # Create outputs directory if it doesn't exist
 mkdir -p outputs
 
-# Compile with Homebrew g++-15
-# -std=c++11: Use C++11 standard
-# -O2: Optimization level 2
+# Compile with Homebrew g++-15 (override with CXX=g++ on Linux)
+CXX=${CXX:-/opt/homebrew/bin/g++-15}
+
+# libicow.so on Linux, libicow.dylib on macOS
+if [ "$(uname)" = "Darwin" ]; then LIBICOW=libicow.dylib; else LIBICOW=libicow.so; fi
+
+# -std=c++14: Use C++14 standard
+# -O3 -march=native: Optimization level 3 with the host's SIMD extensions (AVX2/AVX-512/NEON)
+# -fopenmp-simd: Honor the `#pragma omp simd` loops (no OpenMP runtime needed)
+# -ffp-contract=off: No FMA contraction, so vectorized and scalar paths round identically
+# -pthread: std::thread for the parallel sweep (--sweep)
+# CXXFLAGS_EXTRA: appended to every build, e.g. -DICOW_INSTRUMENT for the sweep counters
 # -o icow_test: Output executable name
-/opt/homebrew/bin/g++-15 -o icow_test icow_debugged.cpp -std=c++11 -O2
+$CXX -o icow_test icow_debugged.cpp -std=c++14 -O3 -march=native -fopenmp-simd -ffp-contract=off -pthread $CXXFLAGS_EXTRA &&
+# icow_benchmark: the kernel microbenchmarks, built with the same flags
+$CXX -o icow_benchmark icow_benchmark.cpp -std=c++14 -O3 -march=native -fopenmp-simd -ffp-contract=off -pthread $CXXFLAGS_EXTRA &&
+# icow_scaling: the whole-pipeline scaling benchmark (threads, block shape, grid size, precision, layout)
+$CXX -o icow_scaling icow_scaling.cpp -std=c++14 -O3 -march=native -fopenmp-simd -ffp-contract=off -pthread $CXXFLAGS_EXTRA &&
+# libicow: the kernels without main as a shared library; -fvisibility=hidden exports only the icow.h entry points
+$CXX -o $LIBICOW icow_debugged.cpp -shared -fPIC -fvisibility=hidden -DICOW_NO_MAIN -std=c++14 -O3 -march=native -fopenmp-simd -ffp-contract=off -pthread $CXXFLAGS_EXTRA
 
 if [ $? -eq 0 ]; then
     echo "✓ Compilation successful!"
     echo "Run with: ./icow_test"
+    echo "Benchmarks: ./icow_benchmark [--json path]"
+    echo "Scaling: ./icow_scaling [--max-threads n] [--csv path] [--json path]"
+    echo "Library: $LIBICOW (C ABI in icow.h)"
 else
     echo "✗ Compilation failed!"
     exit 1
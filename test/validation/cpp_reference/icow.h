@@ -0,0 +1,78 @@
+// C ABI of libicow, the ICOW reference kernels as a shared library
+//
+// Every entry point is batched and works on caller-allocated buffers: nothing is copied,
+// allocated for the caller or kept between calls, so calls from different threads are safe.
+// Arrays of n strategies are plain columns (one double per strategy); full city
+// characterizations are rows of ICOW_NUM_CITY_CHAR doubles, in the cityChar layout of
+// icow_debugged.cpp (caseNum=0, wh=1, ..., dtr=26). Signatures only grow by new functions;
+// ICOW_ABI_VERSION changes if an existing one ever changes.
+
+#ifndef ICOW_H
+#define ICOW_H
+
+#include <stdint.h>
+
+#if defined(_WIN32)
+#define ICOW_API __declspec(dllexport)
+#else
+#define ICOW_API __attribute__((visibility("default")))
+#endif
+
+#define ICOW_ABI_VERSION 1
+#define ICOW_NUM_CITY_CHAR 27   // doubles per city characterization row
+#define ICOW_NUM_DAMAGE 8       // doubles per damage vector (dvt, dvz1..dvz4, dvFE, dvBE, dvTE)
+#define ICOW_NUM_COLUMNS 13     // cost and zone columns: wc, rc, dc, tic, tc, vz1..vz4, tz1..tz4
+#define ICOW_NUM_GRADIENTS 5    // partial derivatives per strategy, by lever: W, R, P, D, B
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ICOW_ABI_VERSION of the loaded library
+ICOW_API int IcowAbiVersion(void);
+
+// Characterize n strategies into rows: cityChars[i*ICOW_NUM_CITY_CHAR + k] is entry k of strategy i,
+// exactly as CharacterizeCity writes it.
+ICOW_API void IcowCharacterize(int64_t n, const double * W, const double * B, const double * R,
+                               const double * P, const double * D, double * cityChars);
+
+// Characterize n strategies into columns: caseNum[i], and column k of ICOW_NUM_COLUMNS at
+// columns[k*n + i]. Same results as IcowCharacterize, vectorized.
+ICOW_API void IcowCharacterizeColumns(int64_t n, const double * W, const double * B, const double * R,
+                                      const double * P, const double * D, int * caseNum, double * columns);
+
+// IcowCharacterizeColumns in single precision
+ICOW_API void IcowCharacterizeColumnsFloat(int64_t n, const float * W, const float * B, const float * R,
+                                           const float * P, const float * D, int * caseNum, float * columns);
+
+// tic and tc of n strategies with their partial derivatives with respect to the levers: caseNum[i],
+// tic[i] and tc[i], and lever k of ICOW_NUM_GRADIENTS at dtic[k*n + i] and dtc[k*n + i]. Values are
+// exactly those of IcowCharacterize; the derivatives come from one forward-mode pass.
+ICOW_API void IcowCharacterizeGradient(int64_t n, const double * W, const double * B, const double * R,
+                                       const double * P, const double * D, int * caseNum, double * tic,
+                                       double * tc, double * dtic, double * dtc);
+
+// Damage of n surge events against one city row: entry k of event i at damage[k*n + i].
+// Bit i%64 of breachMask[i/64] marks a failed dike; NULL means the dike holds.
+ICOW_API void IcowDamage(const double * cityChar, int64_t n, const double * surge,
+                         const uint64_t * breachMask, double * damage);
+
+// Expected annual damage of n city rows under a GEV surge distribution, integrated to relative
+// tolerance rtol
+ICOW_API void IcowExpectedAnnualDamage(int64_t n, const double * cityChars, double loc, double scale,
+                                       double shape, double rtol, double * ead);
+
+// Score n city rows against one block of numSequences x numYears surges (layout 0: sequence
+// major, surge[s*numYears + y]; 1: year major, surge[y*numSequences + s]). breachMask has one
+// bit per event, every row (sequence or year) starting on a new 64-bit word; NULL means the dike
+// holds. Per-sequence totals of strategy i are written at [i*numSequences + s] of damage,
+// floodEvents, breachEvents and thresholdEvents.
+ICOW_API void IcowScoreSurgeBlock(int64_t n, const double * cityChars, const double * surge,
+                                  const uint64_t * breachMask, int numSequences, int numYears, int layout,
+                                  double * damage, int * floodEvents, int * breachEvents, int * thresholdEvents);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ICOW_H
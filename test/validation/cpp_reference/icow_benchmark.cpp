@@ -0,0 +1,256 @@
+// Microbenchmarks of the ICOW reference kernels
+//
+// Builds the kernels of icow_debugged.cpp without its main and times each one over a fixed
+// working set: warm (the working set stays in cache between passes) and cold (the caches are
+// evicted before every pass). Reports ns/eval and evals/s per kernel, as a table and as JSON.
+//
+// Usage: ./icow_benchmark [--json path] [--reps n]
+
+#define ICOW_NO_MAIN
+#include "icow_debugged.cpp"
+
+// timing of one kernel: median over the passes of one working set pass
+struct BenchmarkTiming {
+    double nsPerEval;
+    double evalsPerSecond;
+};
+
+struct BenchmarkResult {
+    string name;
+    int64_t evalsPerPass;
+    BenchmarkTiming warm;
+    BenchmarkTiming cold;
+};
+
+// results are folded into this so no kernel call is optimized away
+volatile double benchmarkSink = 0;
+
+// Eviction buffer: twice the last level cache (at least 32 MiB, at most 512 MiB)
+vector<char>& EvictionBuffer() {
+    static vector<char> buffer;
+    if (buffer.empty()) {
+        int64_t llc = 0;
+#ifdef _SC_LEVEL3_CACHE_SIZE
+        llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+#endif
+        int64_t bytes = std::min<int64_t>(std::max<int64_t>(2 * llc, 32 << 20), 512 << 20);
+        buffer.assign(bytes, 0);
+    }
+    return buffer;
+}
+
+// write every cache line of the eviction buffer, pushing the working set out of L1..L3
+void EvictCaches() {
+    vector<char>& buffer = EvictionBuffer();
+    for (size_t i = 0; i < buffer.size(); i += 64) buffer[i]++;
+    benchmarkSink = benchmarkSink + buffer[buffer.size() / 2];
+}
+
+double MedianOf(vector<double> v) {
+    std::sort(v.begin(), v.end());
+    return v[v.size() / 2];
+}
+
+BenchmarkTiming TimingOf(double secondsPerPass, int64_t evalsPerPass) {
+    BenchmarkTiming t;
+    t.nsPerEval = secondsPerPass * 1e9 / evalsPerPass;
+    t.evalsPerSecond = evalsPerPass / secondsPerPass;
+    return t;
+}
+
+// Time pass() (evalsPerPass evaluations). Warm: after one untimed pass, each rep repeats the
+// pass until at least 2 ms have run. Cold: each rep is one pass right after EvictCaches.
+template <class F>
+BenchmarkResult RunBenchmark(const string& name, int64_t evalsPerPass, int reps, F pass) {
+    typedef std::chrono::steady_clock Clock;
+    BenchmarkResult result;
+    result.name = name;
+    result.evalsPerPass = evalsPerPass;
+
+    pass();
+    vector<double> warm, cold;
+    for (int r = 0; r < reps; r++) {
+        int64_t passes = 0;
+        auto start = Clock::now();
+        double elapsed = 0;
+        do {
+            pass();
+            passes++;
+            elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        } while (elapsed < 2e-3);
+        warm.push_back(elapsed / passes);
+    }
+    for (int r = 0; r < reps; r++) {
+        EvictCaches();
+        auto start = Clock::now();
+        pass();
+        cold.push_back(std::chrono::duration<double>(Clock::now() - start).count());
+    }
+    result.warm = TimingOf(MedianOf(warm), evalsPerPass);
+    result.cold = TimingOf(MedianOf(cold), evalsPerPass);
+    return result;
+}
+
+// the first lever set of a coarse grid that CharacterizeCity puts in each case 1..9
+vector<array<double, 5>> LeversPerCase() {
+    vector<array<double, 5>> found(10, array<double, 5>{{-1, 0, 0, 0, 0}});
+    const double Ws[] = {0, 2, baseValue};
+    const double Rs[] = {0, 3, 6, baseValue};
+    const double Ps[] = {0.5, 0.8};
+    const double Ds[] = {0, 3, 5, baseValue};
+    const double Bs[] = {0, 1, 5, baseValue};
+    for (double W : Ws) for (double R : Rs) for (double P : Ps) for (double D : Ds) for (double B : Bs) {
+        double cityChar[numCityChar];
+        memset(cityChar, 0, sizeof(cityChar));
+        CharacterizeCity(W, B, R, P, D, cityChar);
+        int c = (int)cityChar[caseNum];
+        if (c >= 1 && c <= 9 && found[c][0] < 0) found[c] = array<double, 5>{{W, B, R, P, D}};
+    }
+    return found;
+}
+
+void WriteBenchmarkJson(ostream& out, const vector<BenchmarkResult>& results, int reps) {
+    out << std::setprecision(6);
+    out << "{\n";
+    out << "  \"suite\": \"icow_benchmark\",\n";
+    out << "  \"compiler\": \"" << __VERSION__ << "\",\n";
+    out << "  \"reps\": " << reps << ",\n";
+    out << "  \"eviction_bytes\": " << EvictionBuffer().size() << ",\n";
+    out << "  \"benchmarks\": [\n";
+    for (size_t k = 0; k < results.size(); k++) {
+        const BenchmarkResult& r = results[k];
+        out << "    {\"name\": \"" << r.name << "\", \"evals_per_pass\": " << r.evalsPerPass
+            << ", \"warm\": {\"ns_per_eval\": " << r.warm.nsPerEval << ", \"evals_per_sec\": " << r.warm.evalsPerSecond << "}"
+            << ", \"cold\": {\"ns_per_eval\": " << r.cold.nsPerEval << ", \"evals_per_sec\": " << r.cold.evalsPerSecond << "}}"
+            << (k + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n";
+    out << "}\n";
+}
+
+int main(int argc, char ** argv) {
+    const char * jsonPath = NULL;
+    int reps = 7;
+    for (int a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "--json") == 0 && a + 1 < argc) jsonPath = argv[++a];
+        else if (strcmp(argv[a], "--reps") == 0 && a + 1 < argc) reps = std::max(1, atoi(argv[++a]));
+        else {
+            cerr << "Usage: " << argv[0] << " [--json path] [--reps n]\n";
+            return 1;
+        }
+    }
+    EvictionBuffer();
+    vector<BenchmarkResult> results;
+
+    // dike cost over a spread of heights
+    const int numHeights = 4096;
+    vector<double> heights(numHeights);
+    for (int i = 0; i < numHeights; i++) heights[i] = 0.5 + 9.5 * i / numHeights;
+    results.push_back(RunBenchmark("CalculateDikeCost", numHeights, reps, [&]() {
+        double sum = 0;
+        for (int i = 0; i < numHeights; i++)
+            sum += CalculateDikeCost(heights[i], UnitCostPerVolumeDike, CitySlope, CityWidth, SlopeDike, WidthDikeTop, DikeStartingCostPoint);
+        benchmarkSink = benchmarkSink + sum;
+    }));
+
+    // the scalar city characterization, one case at a time
+    const int numCalls = 4096;
+    vector<array<double, 5>> perCase = LeversPerCase();
+    vector<double> cityChars((size_t)numCalls * numCityChar, 0);
+    for (int c = 1; c <= 9; c++) {
+        if (perCase[c][0] < 0) continue;
+        array<double, 5> lv = perCase[c];
+        results.push_back(RunBenchmark("CharacterizeCity_case" + std::to_string(c), numCalls, reps, [&]() {
+            for (int i = 0; i < numCalls; i++) CharacterizeCity(lv[0], lv[1], lv[2], lv[3], lv[4], &cityChars[(size_t)i * numCityChar]);
+            benchmarkSink = benchmarkSink + cityChars[tc];
+        }));
+    }
+
+    // the batched city characterization over random levers
+    const int numStrategies = 1 << 16;
+    LeverColumns lv = RandomLevers(numStrategies, 20250101);
+    vector<int> caseCol(numStrategies);
+    vector<double> outCols((size_t)13 * numStrategies);
+    double * o = outCols.data();
+    CityColumns columns = {caseCol.data(), o, o + numStrategies, o + 2 * numStrategies, o + 3 * numStrategies, o + 4 * numStrategies,
+                           o + 5 * numStrategies, o + 6 * numStrategies, o + 7 * numStrategies, o + 8 * numStrategies,
+                           o + 9 * numStrategies, o + 10 * numStrategies, o + 11 * numStrategies, o + 12 * numStrategies};
+    results.push_back(RunBenchmark("CharacterizeCityBatch", numStrategies, reps, [&]() {
+        CharacterizeCityBatch(numStrategies, lv.W.data(), lv.B.data(), lv.R.data(), lv.P.data(), lv.D.data(), columns);
+        benchmarkSink = benchmarkSink + columns.tc[0];
+    }));
+    results.push_back(RunBenchmark("CharacterizeCityBatchBranchFree", numStrategies, reps, [&]() {
+        CharacterizeCityBatchBranchFree(numStrategies, lv.W.data(), lv.B.data(), lv.R.data(), lv.P.data(), lv.D.data(), columns);
+        benchmarkSink = benchmarkSink + columns.tc[0];
+    }));
+    vector<float> f[5];
+    const vector<double> * in[5] = {&lv.W, &lv.B, &lv.R, &lv.P, &lv.D};
+    for (int k = 0; k < 5; k++) f[k].assign(in[k]->begin(), in[k]->end());
+    vector<float> outFloat((size_t)13 * numStrategies);
+    float * q = outFloat.data();
+    CityColumnsFloat floatColumns = {caseCol.data(), q, q + numStrategies, q + 2 * numStrategies, q + 3 * numStrategies, q + 4 * numStrategies,
+                                     q + 5 * numStrategies, q + 6 * numStrategies, q + 7 * numStrategies, q + 8 * numStrategies,
+                                     q + 9 * numStrategies, q + 10 * numStrategies, q + 11 * numStrategies, q + 12 * numStrategies};
+    results.push_back(RunBenchmark("CharacterizeCityBatchFloat", numStrategies, reps, [&]() {
+        CharacterizeCityBatchFloat(numStrategies, f[0].data(), f[1].data(), f[2].data(), f[3].data(), f[4].data(), floatColumns);
+        benchmarkSink = benchmarkSink + floatColumns.tc[0];
+    }));
+
+    // event damage for the full protection test case
+    double cityChar[numCityChar];
+    memset(cityChar, 0, sizeof(cityChar));
+    CharacterizeCity(2, 1, 3, 0.8, 5, cityChar);
+    const int numYears = lengthSurgeSequences;
+    const int numSequences = maxSurgeBlock;
+    vector<double> surge((size_t)numSequences * numYears);
+    GenerateSurges(&eadSurges, 0, surge.data(), numSequences, numYears, sequenceMajor, 0, numSequences);
+    const int numEvents = 4096;
+    results.push_back(RunBenchmark("CalculateDamage", numEvents, reps, [&]() {
+        double sum = 0, damageVector[dvLength];
+        for (int i = 0; i < numEvents; i++) {
+            CalculateDamage(cityChar, surge[i], 0, damageVector);
+            sum += damageVector[dvt];
+        }
+        benchmarkSink = benchmarkSink + sum;
+    }));
+    vector<double> damage((size_t)dvLength * numEvents);
+    results.push_back(RunBenchmark("CalculateDamageBlock", numEvents, reps, [&]() {
+        CalculateDamageBlock(cityChar, numEvents, surge.data(), NULL, damage.data());
+        benchmarkSink = benchmarkSink + damage[dvt * numEvents];
+    }));
+
+    // a full surge block in both layouts, with sampled dike failures
+    vector<double> byYear(surge.size());
+    GenerateSurges(&eadSurges, 0, byYear.data(), numSequences, numYears, yearMajor, 0, numSequences);
+    vector<double> seqDamage(numSequences);
+    vector<int> flood(numSequences), breach(numSequences), over(numSequences);
+    SequenceDamage totals = {seqDamage.data(), flood.data(), breach.data(), over.data()};
+    const double * layoutSurges[2] = {surge.data(), byYear.data()};
+    const char * layoutNames[2] = {"SimulateSurgeBlock_sequenceMajor", "SimulateSurgeBlock_yearMajor"};
+    for (int layout = sequenceMajor; layout <= yearMajor; layout++) {
+        SurgeBlock block = {layoutSurges[layout], NULL, numSequences, numYears, layout};
+        vector<uint64_t> mask((size_t)SurgeRowWords(&block) * (layout == yearMajor ? numYears : numSequences));
+        SampleDikeFailures(cityChar, &eadSurges, 0, &block, mask.data());
+        block.breachMask = mask.data();
+        results.push_back(RunBenchmark(layoutNames[layout], (int64_t)numSequences * numYears, reps, [&]() {
+            SimulateSurgeBlock(cityChar, &block, totals);
+            benchmarkSink = benchmarkSink + totals.damage[0];
+        }));
+    }
+
+    cout << std::setprecision(4);
+    cout << "# kernel  evals/pass  warm ns/eval  warm evals/s  cold ns/eval  cold evals/s\n";
+    for (const BenchmarkResult& r : results)
+        cout << r.name << "  " << r.evalsPerPass << "  " << r.warm.nsPerEval << "  " << r.warm.evalsPerSecond
+             << "  " << r.cold.nsPerEval << "  " << r.cold.evalsPerSecond << "\n";
+    if (jsonPath) {
+        ofstream json(jsonPath);
+        WriteBenchmarkJson(json, results, reps);
+        if (!json) {
+            cerr << "Cannot write " << jsonPath << "\n";
+            return 1;
+        }
+        cout << "Wrote " << jsonPath << "\n";
+    }
+    return 0;
+}
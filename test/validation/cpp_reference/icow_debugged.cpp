@@ -41,51 +41,68 @@
 #include <iomanip>
 #include<algorithm>
 #include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <map>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <array>
+#include <limits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "icow.h"
 
 using namespace std;
 
 extern "C" {
-  const double resistanceAdjustment=1.25;
-    const double CEC=17;              //m City Elevation Change, Bennet Park in the Washington Heights area of Manhattan is
-    const double CityWidth=43000.0;                      //m
-    const double CityLength=2000.0;                     //m
+  constexpr double resistanceAdjustment=1.25;
+    constexpr double CEC=17;              //m City Elevation Change, Bennet Park in the Washington Heights area of Manhattan is
+    constexpr double CityWidth=43000.0;                      //m
+    constexpr double CityLength=2000.0;                     //m
     // BUG FIX 5: Corrected slope definition to CEC/CityLength (terrain grade = rise/run)
-    const double CitySlope=CEC/CityLength;  // = 0.0085 (was 0.0465, then incorrectly 21.5)
-    const double TotalCityValueInitial = 1500000000000; // 1,500,000,000,000 1,000,000,000,000  1,00,000,000,000;  50,000,000,000,000
-    const double WithdrawelPercentLost = 0.01;
-    const double BH = 30;//20; //m
-    const double ProtectedValueRatio = 1.1;
-    const double SlopeDike = .5;
-    const double DikeUnprotectedValuationRatio = 0.95;
-    const double WidthDikeTop = 3; //m
-    const double DikeStartingCostPoint = 2;
-    const double UnitCostPerVolumeDike = 10; //$ dollars per m^3
-
-    const double WithdrawelCostFactor = 1.0;
-    const double resistanceExponentialFactor = 0.115;
-    const double resistanceLinearFactor=0.35;//0.45;
-    const double resistanceExponentialThreshold = .4;
-    const double damageFactor = 0.39;
+    constexpr double CitySlope=CEC/CityLength;  // = 0.0085 (was 0.0465, then incorrectly 21.5)
+    constexpr double TotalCityValueInitial = 1500000000000; // 1,500,000,000,000 1,000,000,000,000  1,00,000,000,000;  50,000,000,000,000
+    constexpr double WithdrawelPercentLost = 0.01;
+    constexpr double BH = 30;//20; //m
+    constexpr double ProtectedValueRatio = 1.1;
+    constexpr double SlopeDike = .5;
+    constexpr double DikeUnprotectedValuationRatio = 0.95;
+    constexpr double WidthDikeTop = 3; //m
+    constexpr double DikeStartingCostPoint = 2;
+    constexpr double UnitCostPerVolumeDike = 10; //$ dollars per m^3
+
+    constexpr double WithdrawelCostFactor = 1.0;
+    constexpr double resistanceExponentialFactor = 0.115;
+    constexpr double resistanceLinearFactor=0.35;//0.45;
+    constexpr double resistanceExponentialThreshold = .4;
+    constexpr double damageFactor = 0.39;
     // i.e. damage is worse when the dike fails
-    const double FailedDikeDamageFactor = 1.5; // considers additional damage that resutls because of dike failure
-    const double intactDikeDamageFactor = 0.03;
-    const double pfThreshold=0.95;
-    const double pfBase=.05;
-    const double minHeight=.1;
-    const double Basement=3.0;
-    const double threshold = TotalCityValueInitial/375;
-    const double thresholdDamageFraction = 1.0;
+    constexpr double FailedDikeDamageFactor = 1.5; // considers additional damage that resutls because of dike failure
+    constexpr double intactDikeDamageFactor = 0.03;
+    constexpr double pfThreshold=0.95;
+    constexpr double pfBase=.05;
+    constexpr double minHeight=.1;
+    constexpr double Basement=3.0;
+    constexpr double threshold = TotalCityValueInitial/375;
+    constexpr double thresholdDamageFraction = 1.0;
     // threhold is a demarcation of damage that is considered unacceptable
     // thresholdDamageFraction = 0 causes damage to accumulate at the normal (below threshold) rate
     // threshioldDamageMultiple = 1 causes damage to accululate at normal + normal (2x) below threshold rate
-    const double thresholdDamageExponent = 1.01;
+    constexpr double thresholdDamageExponent = 1.01;
 
     const int lengthSurgeSequences=200;
 
-    const double baseValue=100;
-    const double PBase=0.5;
-    const double Seawall=1.75;  // from Talke
-    const double runUpWave=1.1; // to account for wave/runup. 1.0 results in no increase
+    constexpr double baseValue=100;
+    constexpr double PBase=0.5;
+    constexpr double Seawall=1.75;  // from Talke
+    constexpr double runUpWave=1.1; // to account for wave/runup. 1.0 results in no increase
     const int maxSurgeBlock=5000;
 
 
@@ -179,6 +196,120 @@ extern "C" {
         return result;
     }
 
+    // CalculateDikeCost with everything that doesn't depend on hd hoisted out.
+    // Every term is evaluated exactly as in CalculateDikeCost, so results are bit-identical.
+    struct DikeCostParams {
+        double cd, S, W, sd, wdt, ich;
+        double invSd;   // 1/sd
+        double sd2;     // pow(sd,2)
+        double S2;      // pow(S,2)
+        double S4;      // pow(S,4)
+        double sd2S2;   // pow(sd,2)*pow(S,2)
+        double sd2S4;   // pow(sd,2)*pow(S,4)
+    };
+
+    DikeCostParams PrepareDikeCost(double cd,double S,double W,double sd,double wdt,double ich){
+        DikeCostParams p;
+        p.cd=cd; p.S=S; p.W=W; p.sd=sd; p.wdt=wdt; p.ich=ich;
+        p.invSd=1/sd;
+        p.sd2=pow(sd,2);
+        p.S2=pow(S,2);
+        p.S4=pow(S,4);
+        p.sd2S2=p.sd2*p.S2;
+        p.sd2S4=p.sd2*p.S4;
+        return p;
+    }
+
+    double CalculateDikeCostPrepared(double hd,const DikeCostParams * p){
+        double ch=hd+p->ich;
+        double ch2=pow(ch,2);
+        double ch3=pow(ch,3);
+        double ch4=pow(ch,4);
+        double ch5=pow(ch,5);
+        double ch6=pow(ch,6);
+        double chs=ch+p->invSd;   // ch+1/sd
+        double T = -ch4*pow(chs,2)/p->sd2-
+                   2*(ch5*chs)/p->S4-
+                   4*ch6/p->sd2S4+
+                   4*ch4*(2*ch*chs-3*ch2/p->sd2)/p->sd2S2+
+                   2*ch3*chs/p->S2;
+        double sqrt_T = (T >= 0) ? sqrt(T) : 0.0;
+        double vd=p->W*ch*(p->wdt+ch/p->sd2)+
+                  sqrt_T/6+
+                  p->wdt*(ch2/p->S2);
+        return vd*p->cd;
+    }
+
+    // Dike cost tabulated on a uniform hd grid and evaluated by 4-point (cubic Lagrange) interpolation.
+    // Interpolation error on an interior interval is at most 3/128 * step^4 * max|d^4 cost/dhd^4|
+    // wherever T keeps one sign over the stencil. With the default city T<0 for every hd>=0, so the
+    // cost is quadratic in hd and the table reproduces it to rounding. BuildDikeCostTable measures the
+    // error at every interval midpoint (where it peaks) and stores it in maxRelError.
+    struct DikeCostTable {
+        double hdMin, hdMax, step;
+        vector<double> cost;   // nodes hdMin-step .. hdMax+step, one ghost node per side for the stencil
+        double maxRelError;
+    };
+
+    double DikeCostFromTable(double hd,const DikeCostTable * table,const DikeCostParams * p){
+        if (hd<table->hdMin || hd>table->hdMax) return CalculateDikeCostPrepared(hd,p);
+        double x=(hd-table->hdMin)/table->step;
+        int k=std::min((int)x,(int)table->cost.size()-4);   // interval [k,k+1] of the real grid
+        double t=x-k;
+        const double * f=&table->cost[k];   // f[0..3] = nodes k-1..k+2 (offset by the ghost node)
+        return f[0]*(-t*(t-1)*(t-2)/6)+
+               f[1]*((t+1)*(t-1)*(t-2)/2)+
+               f[2]*(-(t+1)*t*(t-2)/2)+
+               f[3]*((t+1)*t*(t-1)/6);
+    }
+
+    void BuildDikeCostTable(double hdMin,double hdMax,int numIntervals,const DikeCostParams * p,DikeCostTable * table){
+        table->hdMin=hdMin;
+        table->hdMax=hdMax;
+        table->step=(hdMax-hdMin)/numIntervals;
+        table->cost.resize(numIntervals+3);
+        for (int k=0; k<numIntervals+3; k++) table->cost[k]=CalculateDikeCostPrepared(hdMin+(k-1)*table->step,p);
+        table->maxRelError=0;
+        for (int k=0; k<numIntervals; k++) {
+            double hd=hdMin+(k+0.5)*table->step;
+            double exact=CalculateDikeCostPrepared(hd,p);
+            table->maxRelError=std::max(table->maxRelError,fabs(DikeCostFromTable(hd,table,p)-exact)/fabs(exact));
+        }
+    }
+
+    // the production city, prepared once
+    const DikeCostParams cityDikeCost=PrepareDikeCost(UnitCostPerVolumeDike,CitySlope,CityWidth,SlopeDike,WidthDikeTop,DikeStartingCostPoint);
+
+    // Exact dike costs memoized by dike height. A strategy grid revisits each D for every
+    // (R, P, B) it is combined with, so the pow/sqrt chain runs once per distinct height.
+    // Direct-mapped on the bits of hd; a collision just recomputes. Not shared between threads.
+    const int dikeCostCacheSlots=64;   // power of two
+
+    struct DikeCostCache {
+        const DikeCostParams * params;
+        double hd[dikeCostCacheSlots];     // NaN marks an empty slot (never equal to any hd)
+        double cost[dikeCostCacheSlots];
+        int64_t hits, misses;
+    };
+
+    void InitDikeCostCache(const DikeCostParams * p,DikeCostCache * cache){
+        cache->params=p;
+        for (int k=0; k<dikeCostCacheSlots; k++) { cache->hd[k]=NAN; cache->cost[k]=0; }
+        cache->hits=0;
+        cache->misses=0;
+    }
+
+    double CachedDikeCost(double hd,DikeCostCache * cache){
+        uint64_t bits;
+        memcpy(&bits,&hd,sizeof(bits));
+        int slot=(int)((bits*0x9E3779B97F4A7C15ull)>>58);
+        if (cache->hd[slot]==hd) { cache->hits++; return cache->cost[slot]; }
+        cache->misses++;
+        cache->hd[slot]=hd;
+        cache->cost[slot]=CalculateDikeCostPrepared(hd,cache->params);
+        return cache->cost[slot];
+    }
+
 
     double CalculateWithdrawalCost(double * cityChar)
     // vi value of initial infrastructure
@@ -192,6 +323,49 @@ extern "C" {
       return(result);
     }
 
+    // fraction of the protected value spent on resistance, shared by both resiliency cost variants.
+    // At or below the threshold the exponential term is max(0,...)=0, and 0/(1-rp)+x is exactly x.
+    double ResistanceCostFraction(double rp){
+        if (rp<=resistanceExponentialThreshold) return resistanceAdjustment*(rp*resistanceLinearFactor);
+        return resistanceAdjustment*(resistanceExponentialFactor*std::max(0.0,(rp-resistanceExponentialThreshold))/(1.0-rp) +
+               rp*resistanceLinearFactor);
+    }
+
+    // ResistanceCostFraction tabulated over the P values an optimiser samples; other rp are computed
+    const int maxResistanceFractions=64;
+
+    struct ResistanceFractionTable {
+        int count;
+        double rp[maxResistanceFractions];    // ascending, distinct
+        double fcR[maxResistanceFractions];
+    };
+
+    // unused P values beyond maxResistanceFractions are left to the computed path
+    void BuildResistanceFractionTable(int n,const double * P,ResistanceFractionTable * table){
+        table->count=0;
+        for (int i=0; i<n; i++) {
+            int k=table->count;
+            while (k>0 && table->rp[k-1]>P[i]) k--;
+            if ((k>0 && table->rp[k-1]==P[i]) || table->count==maxResistanceFractions || P[i]!=P[i]) continue;
+            for (int j=table->count; j>k; j--) { table->rp[j]=table->rp[j-1]; table->fcR[j]=table->fcR[j-1]; }
+            table->rp[k]=P[i];
+            table->fcR[k]=ResistanceCostFraction(P[i]);
+            table->count++;
+        }
+    }
+
+    double ResistanceFractionLookup(const ResistanceFractionTable * table,double rp){
+        if (table) {
+            int lo=0, hi=table->count;
+            while (lo<hi) {
+                int mid=(lo+hi)/2;
+                if (table->rp[mid]<rp) lo=mid+1; else hi=mid;
+            }
+            if (lo<table->count && table->rp[lo]==rp) return table->fcR[lo];
+        }
+        return ResistanceCostFraction(rp);
+    }
+
     double CalculateResiliencyCost1(double * cityChar){
         //dike base height is lower than resiliency height, there is an unprotected nonResiliant zone
         double fractionResilient=(Basement+cityChar[rh]/2) / BH;
@@ -201,8 +375,7 @@ extern "C" {
                1) ,
              RF2) -
          1);*/
-         double fcR = resistanceAdjustment*(resistanceExponentialFactor*std::max(0.0,(cityChar[rp]-resistanceExponentialThreshold))/(1.0-cityChar[rp]) +
-                  cityChar[rp]*resistanceLinearFactor);
+         double fcR = ResistanceCostFraction(cityChar[rp]);
         // BUG FIX 6: Use V_w (tcvaw) instead of vz1 to match paper Equation 4
         return ( cityChar[tcvaw] * fcR * cityChar[rh] * (cityChar[rh]/2 + Basement) / (BH * (CEC - cityChar[wh])));
     }
@@ -216,8 +389,7 @@ extern "C" {
                1) ,
              RF2) -
          1);*/
-         double fcR = resistanceAdjustment*(resistanceExponentialFactor*std::max(0.0,(cityChar[rp]-resistanceExponentialThreshold))/(1.0-cityChar[rp]) +
-                  cityChar[rp]*resistanceLinearFactor);
+         double fcR = ResistanceCostFraction(cityChar[rp]);
         // BUG FIX 6: Use V_w (tcvaw) and B (dbh) to match paper Equation 5
         return( cityChar[tcvaw] * fcR * cityChar[dbh] * (cityChar[rh] - cityChar[dbh]/2 + Basement) / (BH * (CEC - cityChar[wh])));
     }
@@ -518,93 +690,5083 @@ extern "C" {
 
     }
 
+    // Everything CharacterizeCity derives from the withdrawal height alone, computed once per W.
+    // The shared divisor CEC-wh and the products that lead the zone value and resiliency cost
+    // expressions are stored as left-to-right prefixes, so the staged evaluation is bit-identical.
+    struct WithdrawalStage {
+        double wh, wc, fw, ilfw, tcvaw;
+        double remaining;          // CEC-wh
+        double unprotectedValue;   // tcvaw*DikeUnprotectedValuationRatio
+        double protectedValue;     // tcvaw*ProtectedValueRatio
+        double resiliencyBase;     // BH*(CEC-wh)
+    };
+
+    void PrepareWithdrawal(double W,WithdrawalStage * stage){
+        stage->wh=(W==baseValue) ? 0.0 : W;
+        stage->remaining=CEC-stage->wh;
+        stage->wc=(stage->wh==0) ? 0 : TotalCityValueInitial*stage->wh/stage->remaining*WithdrawelCostFactor;
+        stage->fw=stage->wh/CEC;
+        stage->ilfw=TotalCityValueInitial*stage->fw*WithdrawelPercentLost;
+        stage->tcvaw=TotalCityValueInitial*(1.0 - WithdrawelPercentLost*stage->wh/CEC);
+        stage->unprotectedValue=stage->tcvaw*DikeUnprotectedValuationRatio;
+        stage->protectedValue=stage->tcvaw*ProtectedValueRatio;
+        stage->resiliencyBase=BH*stage->remaining;
+    }
+
+    // CharacterizeCity for one (R, P, D, B) against a prepared withdrawal height. Fills the same
+    // cityChar entries with the same values; dike costs come from dikeCache and fcR from fractions
+    // when they are not NULL.
+    void CharacterizeCityStaged(const WithdrawalStage * stage,DikeCostCache * dikeCache,const ResistanceFractionTable * fractions,
+                                double B,double R,double P,double D,double * cityChar){
+        // lever rules, as in CharacterizeCity
+        cityChar[wh]=stage->wh;
+        bool noR=(R==baseValue || R<minHeight);
+        cityChar[rh]=noR ? 0.0 : R;
+        cityChar[rp]=noR ? 0.5 : P;
+        cityChar[dh]=(D==baseValue) ? 0.0 : D;
+        cityChar[dbh]=(B<minHeight || B==baseValue) ? 0.0 : B;
+        cityChar[dtr]=std::max(1-cityChar[rp],0.0);
+        if ((cityChar[dh]>=minHeight)&&(cityChar[dbh]<minHeight)&&(cityChar[rh]>=minHeight)) {
+            cityChar[dbh]=0;
+            cityChar[rh]=0;
+        }
+        double whv=stage->wh, rhv=cityChar[rh], dbhv=cityChar[dbh], dhv=cityChar[dh], rpv=cityChar[rp];
+        int c;
+        if (dhv>0) c=(dbhv>0) ? ((rhv>0) ? ((rhv<dbhv) ? 1 : 2) : 3) : 4;
+        else c=(dbhv>0) ? ((rhv>0) ? ((rhv<dbhv) ? 5 : 6) : 7) : ((rhv>0) ? 8 : 9);
+
+        cityChar[tcvi]=TotalCityValueInitial;
+        cityChar[wc]=stage->wc;
+        cityChar[fw]=stage->fw;
+        cityChar[ilfw]=stage->ilfw;
+        cityChar[tcvaw]=stage->tcvaw;
+        cityChar[caseNum]=c;
+
+        double tcvawv=stage->tcvaw, remaining=stage->remaining;
+        // CalculateResiliencyCost1/2 share fcR and the divisor
+        double fcR=(c==1 || c==2 || c==5 || c==6 || c==8) ? ResistanceFractionLookup(fractions,rpv) : 0;
+        double dcv=0;
+        if (c<=5 || c==7)
+            dcv=dikeCache ? CachedDikeCost(dhv,dikeCache)
+                          : CalculateDikeCost(dhv,UnitCostPerVolumeDike,CitySlope,CityWidth,SlopeDike,WidthDikeTop,DikeStartingCostPoint);
+        double vz1v=0, vz2v=0, vz3v=0, vz4v=0, fcvv=0, tz1v=whv, tz2v=whv, tz3v=whv, rcv=0;
+        switch (c) {
+            case 1:
+                vz1v=stage->unprotectedValue*rhv/remaining;
+                vz2v=stage->unprotectedValue*(dbhv-rhv)/remaining;
+                vz3v=stage->protectedValue*dhv/remaining;
+                vz4v=tcvawv*(remaining-dbhv-dhv)/remaining;
+                fcvv=vz1v+vz2v+vz3v+vz4v;
+                tz1v=whv+rhv; tz2v=whv+dbhv; tz3v=whv+dbhv+dhv;
+                rcv=tcvawv*fcR*rhv*(rhv/2 + Basement)/stage->resiliencyBase;
+                break;
+            case 2:
+                vz1v=stage->unprotectedValue*dbhv/remaining;
+                vz3v=stage->protectedValue*dhv/remaining;
+                vz4v=tcvawv*(remaining-dbhv-dhv)/remaining;
+                fcvv=vz2v+vz3v+vz4v;
+                tz1v=whv+dbhv; tz2v=whv+dbhv; tz3v=whv+dbhv+dhv;
+                rcv=tcvawv*fcR*dbhv*(rhv - dbhv/2 + Basement)/stage->resiliencyBase;
+                break;
+            case 3:
+                vz2v=stage->unprotectedValue*dbhv/remaining;
+                vz3v=stage->protectedValue*dhv/remaining;
+                vz4v=tcvawv*(remaining-dbhv-dhv)/remaining;
+                fcvv=vz2v+vz3v+vz4v;
+                tz2v=whv+dbhv; tz3v=whv+dbhv+dhv;
+                break;
+            case 4:
+                vz3v=stage->protectedValue*dhv/remaining;
+                vz4v=tcvawv*(remaining-dhv)/remaining;
+                fcvv=vz3v+vz4v;
+                tz3v=whv+dhv;
+                break;
+            case 5:
+                vz1v=stage->unprotectedValue*rhv/remaining;
+                vz2v=stage->unprotectedValue*(dbhv-rhv)/remaining;
+                vz4v=tcvawv*(remaining-dbhv)/remaining;
+                fcvv=vz1v+vz2v+vz4v;
+                tz1v=whv+rhv; tz2v=whv+dbhv; tz3v=tz2v;
+                rcv=tcvawv*fcR*rhv*(rhv/2 + Basement)/stage->resiliencyBase;
+                break;
+            case 6:
+                vz1v=stage->unprotectedValue*dbhv/remaining;
+                vz4v=tcvawv*(remaining-dbhv)/remaining;
+                fcvv=vz1v+vz4v;
+                tz1v=whv+dbhv; tz2v=tz1v; tz3v=tz1v;
+                rcv=tcvawv*fcR*dbhv*(rhv - dbhv/2 + Basement)/stage->resiliencyBase;
+                break;
+            case 7:
+                vz2v=stage->unprotectedValue*dbhv/remaining;
+                vz4v=tcvawv*(remaining-dbhv)/remaining;
+                fcvv=vz2v+vz4v;
+                tz2v=whv+dbhv; tz3v=tz2v;
+                break;
+            case 8:
+                vz1v=tcvawv*rhv/remaining;
+                vz4v=tcvawv*(remaining-rhv)/remaining;
+                fcvv=vz1v+vz4v;
+                tz1v=whv+rhv; tz2v=tz1v; tz3v=tz1v;
+                rcv=tcvawv*fcR*rhv*(rhv/2 + Basement)/stage->resiliencyBase;
+                break;
+            case 9:
+                vz4v=tcvawv;
+                fcvv=vz4v;
+                break;
+        }
+        cityChar[dc]=dcv;
+        cityChar[vz1]=vz1v; cityChar[vz2]=vz2v; cityChar[vz3]=vz3v; cityChar[vz4]=vz4v;
+        cityChar[fcv]=fcvv;
+        cityChar[tz1]=tz1v; cityChar[tz2]=tz2v; cityChar[tz3]=tz3v; cityChar[tz4]=CEC;
+        cityChar[rc]=rcv;
+        // adding rc=0 or dc=0 is exact, so one formula covers every case
+        cityChar[tic]=stage->wc+dcv+rcv;
+        cityChar[tc]=(c==9) ? TotalCityValueInitial-fcvv : cityChar[tic]+fcvv-TotalCityValueInitial;
+    }
+
+    // output columns for the batched (struct-of-arrays) interface
+    // each pointer addresses n contiguous values, one per strategy
+    struct CityColumns {
+        int * caseNum;
+        double * wc;
+        double * rc;
+        double * dc;
+        double * tic;
+        double * tc;
+        double * vz1;
+        double * vz2;
+        double * vz3;
+        double * vz4;
+        double * tz1;
+        double * tz2;
+        double * tz3;
+        double * tz4;
+    };
+
+    // the same columns in single precision, for CharacterizeCityBatchFloat
+    struct CityColumnsFloat {
+        int * caseNum;
+        float * wc;
+        float * rc;
+        float * dc;
+        float * tic;
+        float * tc;
+        float * vz1;
+        float * vz2;
+        float * vz3;
+        float * vz4;
+        float * tz1;
+        float * tz2;
+        float * tz3;
+        float * tz4;
+    };
+
+    void CharacterizeCityBatch (int n,const double * W,const double * B,const double * R,const double * P,const double * D, CityColumns out) {
+        // strategy i is (W[i],B[i],R[i],P[i],D[i]); results are identical to CharacterizeCity
+        double cityChar[numCityChar];
+        for (int i=0; i<n; i++) {
+            CharacterizeCity(W[i],B[i],R[i],P[i],D[i],cityChar);
+            out.caseNum[i] = (int)cityChar[caseNum];
+            out.wc[i]  = cityChar[wc];
+            out.rc[i]  = cityChar[rc];
+            out.dc[i]  = cityChar[dc];
+            out.tic[i] = cityChar[tic];
+            out.tc[i]  = cityChar[tc];
+            out.vz1[i] = cityChar[vz1];
+            out.vz2[i] = cityChar[vz2];
+            out.vz3[i] = cityChar[vz3];
+            out.vz4[i] = cityChar[vz4];
+            out.tz1[i] = cityChar[tz1];
+            out.tz2[i] = cityChar[tz2];
+            out.tz3[i] = cityChar[tz3];
+            out.tz4[i] = cityChar[tz4];
+        }
+    }
+
+    // surge height after the seawall and wave runup (effective_surge in src/Core/costs.jl)
+    double EffectiveSurge(double surge) {
+        return (surge<=Seawall) ? 0.0 : surge*runUpWave-Seawall;
+    }
+
+    // damage to one zone before zone-specific factors (base_zone_damage in src/Core/damage.jl)
+    // written without branches so the block loop below vectorizes
+    inline double BaseZoneDamage(double zLow,double zHigh,double value,double hs) {
+        double washOver = hs-zLow;   // only used when positive
+        double zoneHeight = zHigh-zLow;
+        double partial = washOver*(washOver/2+Basement)/(BH*zoneHeight);  // zone partly flooded
+        double full = (Basement+zoneHeight/2)/BH;                          // zone fully flooded
+        double floodFraction = (washOver<zoneHeight) ? partial : full;
+        double damage = value*floodFraction*damageFactor;
+        damage = (hs>zLow) ? damage : 0.0;
+        damage = (value>0) ? damage : 0.0;
+        return (zHigh>zLow) ? damage : 0.0;
+    }
+
+    // damage from one surge event, written to damageVector[dvt..dvTE]
+    // matches total_event_damage(effective_surge(surge), ..., dikeFailed) in src/Core/damage.jl
+    void CalculateDamage(const double * cityChar, double surge, int dikeFailed, double * damageVector) {
+        double hs = EffectiveSurge(surge);
+        damageVector[dvz1] = BaseZoneDamage(cityChar[wh],cityChar[tz1],cityChar[vz1],hs)*cityChar[dtr];
+        damageVector[dvz2] = BaseZoneDamage(cityChar[tz1],cityChar[tz2],cityChar[vz2],hs);
+        damageVector[dvz3] = BaseZoneDamage(cityChar[tz2],cityChar[tz3],cityChar[vz3],hs)*
+                             (dikeFailed ? FailedDikeDamageFactor : intactDikeDamageFactor);
+        damageVector[dvz4] = BaseZoneDamage(cityChar[tz3],cityChar[tz4],cityChar[vz4],hs);
+        double total = damageVector[dvz1]+damageVector[dvz2]+damageVector[dvz3]+damageVector[dvz4];
+        damageVector[dvFE] = (total>0) ? 1 : 0;
+        damageVector[dvBE] = (dikeFailed && cityChar[dh]>0) ? 1 : 0;
+        damageVector[dvTE] = (total>threshold) ? 1 : 0;
+        // damage beyond the threshold is penalized
+        if (total>threshold) total += pow(thresholdDamageFraction*(total-threshold),thresholdDamageExponent);
+        damageVector[dvt] = total;
+    }
+
+    // damage from n surge events against one city. damage holds dvLength columns of n values,
+    // damage[k*n+i] being entry k of the damage vector of event i. Bit i of breachMask (64 events
+    // per word) marks a failed dike; a NULL mask means the dike holds for every event.
+    void CalculateDamageBlock(const double * cityChar, int n, const double * surge, const uint64_t * breachMask, double * damage) {
+        double * dt = damage+dvt*n;
+        double * d1 = damage+dvz1*n;
+        double * d2 = damage+dvz2*n;
+        double * d3 = damage+dvz3*n;
+        double * d4 = damage+dvz4*n;
+        double * fe = damage+dvFE*n;
+        double * be = damage+dvBE*n;
+        double * te = damage+dvTE*n;
+        double w=cityChar[wh], t1=cityChar[tz1], t2=cityChar[tz2], t3=cityChar[tz3], t4=cityChar[tz4];
+        double v1=cityChar[vz1], v2=cityChar[vz2], v3=cityChar[vz3], v4=cityChar[vz4];
+        double resist=cityChar[dtr];
+        bool hasDike=(cityChar[dh]>0);
+
+        // events are taken one 64-bit mask word at a time, the word first unpacked into doubles
+        // so the vector loop stays at one lane width. The threshold penalty needs pow, which
+        // doesn't vectorize, so it is applied afterwards to the few events that need it
+        double failed[64];
+        for (int base=0; base<n; base+=64) {
+            uint64_t word = breachMask ? breachMask[base>>6] : 0;
+            int m = std::min(64,n-base);
+            for (int j=0; j<m; j++) failed[j] = (double)((word>>j)&1);
+            const double * hsurge = surge+base;
+            #pragma omp simd
+            for (int j=0; j<m; j++) {
+                int i = base+j;
+                double hs = EffectiveSurge(hsurge[j]);
+                double z1 = BaseZoneDamage(w,t1,v1,hs)*resist;
+                double z2 = BaseZoneDamage(t1,t2,v2,hs);
+                double z3 = BaseZoneDamage(t2,t3,v3,hs)*((failed[j]>0) ? FailedDikeDamageFactor : intactDikeDamageFactor);
+                double z4 = BaseZoneDamage(t3,t4,v4,hs);
+                double total = z1+z2+z3+z4;
+                d1[i] = z1;
+                d2[i] = z2;
+                d3[i] = z3;
+                d4[i] = z4;
+                dt[i] = total;
+                fe[i] = (total>0) ? 1.0 : 0.0;
+                be[i] = hasDike ? failed[j] : 0.0;
+                te[i] = (total>threshold) ? 1.0 : 0.0;
+            }
+        }
+        for (int i=0; i<n; i++) {
+            if (te[i]>0) dt[i] += pow(thresholdDamageFraction*(dt[i]-threshold),thresholdDamageExponent);
+        }
+    }
+
+    // surge block layouts: sequenceMajor stores surge[s*numYears+y] (each sequence contiguous),
+    // yearMajor stores surge[y*numSequences+s] (each year of all sequences contiguous)
+    const int sequenceMajor=0;
+    const int yearMajor=1;
+
+    // events per tile of the surge simulator, one breach mask word
+    const int surgeTile=64;
+
+    // a block of surge sequences, by default maxSurgeBlock sequences of lengthSurgeSequences years.
+    // Bit c of breachMask[r*rowWords+c/64] marks a failed dike at column c of row r, rows being
+    // sequences (sequenceMajor) or years (yearMajor) and every row starting on a new word;
+    // a NULL mask means the dike never fails.
+    struct SurgeBlock {
+        const double * surge;
+        const uint64_t * breachMask;
+        int numSequences;
+        int numYears;
+        int layout;
+    };
+
+    // per-sequence totals over all years, one value per sequence
+    struct SequenceDamage {
+        double * damage;        // sum of dvt
+        int * floodEvents;      // years with dvFE
+        int * breachEvents;     // years with dvBE
+        int * thresholdEvents;  // years with dvTE
+    };
+
+    // mask words per row of a SurgeBlock
+    int SurgeRowWords(const SurgeBlock * block) {
+        int rowLength = (block->layout==yearMajor) ? block->numSequences : block->numYears;
+        return (rowLength+surgeTile-1)/surgeTile;
+    }
+
+    // score one city against sequences [begin,end) of a surge block, writing out[begin..end).
+    // The block is walked in tiles of surgeTile events run through CalculateDamageBlock with a
+    // fixed scratch buffer. Damage is summed in year order for either layout, so both layouts
+    // give identical results. For a year-major block begin must be a multiple of surgeTile.
+    void SimulateSurgeSequences(const double * cityChar, const SurgeBlock * block, int begin, int end, SequenceDamage out) {
+        // scratch holds the dvLength columns of one tile of m events, column k at scratch+k*m
+        double scratch[dvLength*surgeTile];
+        int nY = block->numYears;
+        int rowWords = SurgeRowWords(block);
+
+        if (block->layout==yearMajor) {
+            // a tile is surgeTile sequences of one year; the tile's totals stay in cache over all years
+            for (int s0=begin; s0<end; s0+=surgeTile) {
+                int m = std::min(surgeTile,end-s0);
+                for (int j=0; j<m; j++) {
+                    out.damage[s0+j] = 0;
+                    out.floodEvents[s0+j] = 0;
+                    out.breachEvents[s0+j] = 0;
+                    out.thresholdEvents[s0+j] = 0;
+                }
+                for (int y=0; y<nY; y++) {
+                    const uint64_t * mask = block->breachMask ? block->breachMask+y*rowWords+s0/surgeTile : NULL;
+                    CalculateDamageBlock(cityChar,m,block->surge+(size_t)y*block->numSequences+s0,mask,scratch);
+                    for (int j=0; j<m; j++) {
+                        out.damage[s0+j] += scratch[dvt*m+j];
+                        out.floodEvents[s0+j] += (int)scratch[dvFE*m+j];
+                        out.breachEvents[s0+j] += (int)scratch[dvBE*m+j];
+                        out.thresholdEvents[s0+j] += (int)scratch[dvTE*m+j];
+                    }
+                }
+            }
+        } else {
+            // a tile is surgeTile consecutive years of one sequence
+            for (int s=begin; s<end; s++) {
+                double damage = 0;
+                int flood = 0, breach = 0, over = 0;
+                for (int y0=0; y0<nY; y0+=surgeTile) {
+                    int m = std::min(surgeTile,nY-y0);
+                    const uint64_t * mask = block->breachMask ? block->breachMask+s*rowWords+y0/surgeTile : NULL;
+                    CalculateDamageBlock(cityChar,m,block->surge+(size_t)s*nY+y0,mask,scratch);
+                    for (int j=0; j<m; j++) {
+                        damage += scratch[dvt*m+j];
+                        flood += (int)scratch[dvFE*m+j];
+                        breach += (int)scratch[dvBE*m+j];
+                        over += (int)scratch[dvTE*m+j];
+                    }
+                }
+                out.damage[s] = damage;
+                out.floodEvents[s] = flood;
+                out.breachEvents[s] = breach;
+                out.thresholdEvents[s] = over;
+            }
+        }
+    }
+
+    // score one city against every sequence of a surge block
+    void SimulateSurgeBlock(const double * cityChar, const SurgeBlock * block, SequenceDamage out) {
+        SimulateSurgeSequences(cityChar,block,0,block->numSequences,out);
+    }
+
+
+    // ---- counter-based surge generation ----
+    // Philox4x32-10 (Salmon et al., 2011): each output is a fixed function of a 128-bit counter
+    // and a 64-bit key, so any (sequence, year) can be drawn without the ones before it.
+
+    inline void PhiloxRound(uint32_t& c0, uint32_t& c1, uint32_t& c2, uint32_t& c3, uint32_t k0, uint32_t k1) {
+        uint64_t p0 = (uint64_t)0xD2511F53u*c0;
+        uint64_t p1 = (uint64_t)0xCD9E8D57u*c2;
+        uint32_t n0 = (uint32_t)(p1>>32)^c1^k0;
+        uint32_t n2 = (uint32_t)(p0>>32)^c3^k1;
+        c1 = (uint32_t)p1;
+        c3 = (uint32_t)p0;
+        c0 = n0;
+        c2 = n2;
+    }
+
+    // the counter c0..c3 is replaced by the generator output
+    inline void Philox4x32(uint32_t& c0, uint32_t& c1, uint32_t& c2, uint32_t& c3, uint32_t k0, uint32_t k1) {
+        #pragma GCC unroll 10
+        for (int r=0; r<10; r++) {
+            PhiloxRound(c0,c1,c2,c3,k0,k1);
+            k0 += 0x9E3779B9u;
+            k1 += 0xBB67AE85u;
+        }
+    }
+
+    // uniform on the open interval (0,1) from 53 of the 64 bits hi:lo
+    inline double PhiloxUniform(uint32_t hi, uint32_t lo) {
+        return ((double)(((uint64_t)hi<<21)|(lo>>11))+0.5)*(1.0/9007199254740992.0);
+    }
+
+    // counter streams, so draws for different purposes at the same (sequence, year) are independent
+    const uint32_t surgeStream=0;
+
+    // GEV surge distribution and generator key. Sequence ids are global: the first sequence of a
+    // block is firstSequence, so the blocks of a long run draw disjoint surges.
+    struct SurgeGenerator {
+        uint64_t seed;
+        double loc;
+        double scale;
+        double shape;
+    };
+
+    // the two uniforms at counter (year, sequence, stream, 0)
+    inline void CounterUniforms(uint64_t seed, uint32_t stream, uint64_t sequence, uint32_t year, double * u0, double * u1) {
+        uint32_t c0=year, c1=(uint32_t)sequence, c2=(uint32_t)(sequence>>32)^(stream<<16), c3=0;  // up to 2^48 sequences
+        Philox4x32(c0,c1,c2,c3,(uint32_t)seed,(uint32_t)(seed>>32));
+        *u0 = PhiloxUniform(c0,c1);
+        *u1 = PhiloxUniform(c2,c3);
+    }
+
+    // GEV quantile: loc + scale*((-log u)^(-shape) - 1)/shape, or loc - scale*log(-log u) for shape 0
+    inline double GevQuantile(const SurgeGenerator * gen, double u) {
+        double t = -log(u);
+        if (gen->shape==0) return gen->loc-gen->scale*log(t);
+        return gen->loc+gen->scale*(pow(t,-gen->shape)-1)/gen->shape;
+    }
+
+    // Fill sequences [begin,end) of a numSequences x numYears surge buffer in the given layout.
+    // Every surge depends only on (seed, firstSequence+s, y), so any split of the sequences over
+    // threads gives the same buffer. The Philox rounds run as a SIMD loop along the contiguous
+    // direction; the GEV transform (log, pow) is a second pass.
+    void GenerateSurges(const SurgeGenerator * gen, uint64_t firstSequence, double * surge,
+                        int numSequences, int numYears, int layout, int begin, int end) {
+        uint32_t k0=(uint32_t)gen->seed, k1=(uint32_t)(gen->seed>>32);
+        if (layout==yearMajor) {
+            for (int y=0; y<numYears; y++) {
+                double * row = surge+(size_t)y*numSequences;
+                #pragma omp simd
+                for (int s=begin; s<end; s++) {
+                    uint64_t sequence = firstSequence+s;
+                    uint32_t c0=y, c1=(uint32_t)sequence, c2=(uint32_t)(sequence>>32)^(surgeStream<<16), c3=0;
+                    Philox4x32(c0,c1,c2,c3,k0,k1);
+                    row[s] = PhiloxUniform(c0,c1);
+                }
+                for (int s=begin; s<end; s++) row[s] = GevQuantile(gen,row[s]);
+            }
+        } else {
+            for (int s=begin; s<end; s++) {
+                double * row = surge+(size_t)s*numYears;
+                uint64_t sequence = firstSequence+s;
+                #pragma omp simd
+                for (int y=0; y<numYears; y++) {
+                    uint32_t c0=y, c1=(uint32_t)sequence, c2=(uint32_t)(sequence>>32)^(surgeStream<<16), c3=0;
+                    Philox4x32(c0,c1,c2,c3,k0,k1);
+                    row[y] = PhiloxUniform(c0,c1);
+                }
+                for (int y=0; y<numYears; y++) row[y] = GevQuantile(gen,row[y]);
+            }
+        }
+    }
+
+
+    // ---- dike failure ----
+
+    // probability that a dike of height D fails under a surge hAtDike above its base
+    // (dike_failure_probability in src/Core/costs.jl). Written with selects so it vectorizes;
+    // for pfThreshold>=1 the ramp is never selected, matching the instant transition there.
+    inline double DikeFailureProbability(double hAtDike, double D) {
+        double numerator = hAtDike-pfThreshold*D;
+        double denominator = D*(1-pfThreshold);
+        double p = (hAtDike<D) ? numerator/denominator : 1.0;
+        p = (hAtDike<pfThreshold*D) ? pfBase : p;
+        double noDike = (hAtDike>0) ? 1.0 : pfBase;  // no dike: certain failure once wet
+        return (D==0) ? noDike : p;
+    }
+
+    // surge above the dike base W+B, the h_surge argument of dike_failure_probability
+    inline double SurgeAtDike(const double * cityChar, double surge) {
+        return std::max(0.0,EffectiveSurge(surge)-(cityChar[wh]+cityChar[dbh]));
+    }
+
+    const uint32_t breachStream=1;
+
+    // Draw dike failure for every event of a surge block into breachMask (the row layout of
+    // SurgeBlock.breachMask, SurgeRowWords(block) words per row), failing when the uniform at
+    // counter (year, firstSequence+s, breachStream) is below the failure probability. Like the
+    // surges, each draw depends only on the seed, sequence and year.
+    void SampleDikeFailures(const double * cityChar, const SurgeGenerator * gen, uint64_t firstSequence,
+                            const SurgeBlock * block, uint64_t * breachMask) {
+        uint32_t k0=(uint32_t)gen->seed, k1=(uint32_t)(gen->seed>>32);
+        double D=cityChar[dh];
+        bool yearRows = (block->layout==yearMajor);
+        int numRows = yearRows ? block->numYears : block->numSequences;
+        int rowLength = yearRows ? block->numSequences : block->numYears;
+        int rowWords = SurgeRowWords(block);
+        double failed[surgeTile];
+        for (int r=0; r<numRows; r++) {
+            for (int t0=0; t0<rowLength; t0+=surgeTile) {
+                int m = std::min(surgeTile,rowLength-t0);
+                const double * surge = block->surge+(size_t)r*rowLength+t0;
+                #pragma omp simd
+                for (int j=0; j<m; j++) {
+                    uint64_t sequence = firstSequence+(yearRows ? t0+j : r);
+                    uint32_t c0=yearRows ? r : t0+j, c1=(uint32_t)sequence, c2=(uint32_t)(sequence>>32)^(breachStream<<16), c3=0;
+                    Philox4x32(c0,c1,c2,c3,k0,k1);
+                    double u = PhiloxUniform(c0,c1);
+                    failed[j] = (u<DikeFailureProbability(SurgeAtDike(cityChar,surge[j]),D)) ? 1.0 : 0.0;
+                }
+                uint64_t word = 0;
+                for (int j=0; j<m; j++) word |= (uint64_t)(failed[j]>0)<<j;
+                breachMask[(size_t)r*rowWords+t0/surgeTile] = word;
+            }
+        }
+    }
+
+
+    // ---- expected damage ----
+
+    // GEV density at surge h for the generator's loc, scale and shape
+    inline double GevPdf(const SurgeGenerator * gen, double h) {
+        double z = (h-gen->loc)/gen->scale;
+        double t;
+        if (gen->shape==0) {
+            t = exp(-z);
+        } else {
+            double a = 1+gen->shape*z;
+            if (a<=0) return 0;  // outside the support
+            t = pow(a,-1/gen->shape);
+        }
+        return pow(t,gen->shape+1)*exp(-t)/gen->scale;
+    }
+
+    // the threshold penalty CalculateDamage adds to a total zone damage
+    inline double ThresholdPenalty(double total) {
+        return (total>threshold) ? pow(thresholdDamageFraction*(total-threshold),thresholdDamageExponent) : 0.0;
+    }
+
+    // damage at one surge averaged over dike failure (expected_damage_given_surge in src/Core/damage.jl)
+    double ExpectedDamageGivenSurge(const double * cityChar, double surge) {
+        double pFail = DikeFailureProbability(SurgeAtDike(cityChar,surge),cityChar[dh]);
+        double intact[dvLength], failed[dvLength];
+        CalculateDamage(cityChar,surge,0,intact);
+        CalculateDamage(cityChar,surge,1,failed);
+        return pFail*failed[dvt]+(1-pFail)*intact[dvt];
+    }
+
 } // extern "C"
 
 
 // ========================================
-// TEST HARNESS - Generate reference outputs
+// CITY PARAMETER SETS
 // ========================================
 
-using namespace std;
+// All model constants as one value, so several cities can be evaluated in one process.
+// Defaults are the constants above; after changing a field, call DeriveCityParams to refresh
+// the derived quantities (CitySlope, threshold).
+struct CityParams {
+    double resistanceAdjustment = ::resistanceAdjustment;
+    double CEC = ::CEC;
+    double CityWidth = ::CityWidth;
+    double CityLength = ::CityLength;
+    double TotalCityValueInitial = ::TotalCityValueInitial;
+    double WithdrawelPercentLost = ::WithdrawelPercentLost;
+    double BH = ::BH;
+    double ProtectedValueRatio = ::ProtectedValueRatio;
+    double SlopeDike = ::SlopeDike;
+    double DikeUnprotectedValuationRatio = ::DikeUnprotectedValuationRatio;
+    double WidthDikeTop = ::WidthDikeTop;
+    double DikeStartingCostPoint = ::DikeStartingCostPoint;
+    double UnitCostPerVolumeDike = ::UnitCostPerVolumeDike;
+    double WithdrawelCostFactor = ::WithdrawelCostFactor;
+    double resistanceExponentialFactor = ::resistanceExponentialFactor;
+    double resistanceLinearFactor = ::resistanceLinearFactor;
+    double resistanceExponentialThreshold = ::resistanceExponentialThreshold;
+    double damageFactor = ::damageFactor;
+    double FailedDikeDamageFactor = ::FailedDikeDamageFactor;
+    double intactDikeDamageFactor = ::intactDikeDamageFactor;
+    double pfThreshold = ::pfThreshold;
+    double pfBase = ::pfBase;
+    double minHeight = ::minHeight;
+    double Basement = ::Basement;
+    double thresholdDamageFraction = ::thresholdDamageFraction;
+    double thresholdDamageExponent = ::thresholdDamageExponent;
+    double baseValue = ::baseValue;
+    double PBase = ::PBase;
+    double Seawall = ::Seawall;
+    double runUpWave = ::runUpWave;
 
-struct TestCase {
-    string name;
-    double W, R, P, D, B;  // Levers
-    double h_surge;         // Surge height for damage calculation
+    // derived, see DeriveCityParams
+    double CitySlope = ::CitySlope;
+    double threshold = ::threshold;
 };
 
-int main() {
-    // Define 8 test cases covering edge cases and typical scenarios
-    vector<TestCase> test_cases = {
-        {"zero_case", 0, 0, 0, 0, 0, 0},
-        {"dike_only", 0, 0, 0, 5, 0, 3},
-        {"full_protection", 2, 3, 0.8, 5, 1, 4},
-        {"resistance_only", 0, 4, 0.5, 0, 0, 2},
-        {"withdrawal_only", 5, 0, 0, 0, 0, 3},
-        {"edge_r_geq_b", 0, 6, 0.5, 3, 5, 4},
-        {"high_surge", 2, 3, 0.8, 5, 1, 15},
-        {"below_seawall", 0, 0, 0, 0, 0, 1.5}
-    };
+constexpr CityParams DeriveCityParams(CityParams city) {
+    city.CitySlope = city.CEC/city.CityLength;
+    city.threshold = city.TotalCityValueInitial/375;
+    return city;
+}
 
-    // Open output files
-    ofstream costs_out("outputs/costs.txt");
-    ofstream zones_out("outputs/zones.txt");
-    ofstream summary_out("outputs/summary.txt");
+// the production city, known at compile time
+constexpr CityParams productionCity = DeriveCityParams(CityParams());
 
-    // Set high precision for outputs
-    costs_out << std::setprecision(15);
-    zones_out << std::setprecision(15);
-    summary_out << std::setprecision(15);
+DikeCostParams PrepareCityDikeCost(const CityParams & city) {
+    return PrepareDikeCost(city.UnitCostPerVolumeDike,city.CitySlope,city.CityWidth,city.SlopeDike,city.WidthDikeTop,city.DikeStartingCostPoint);
+}
 
-    // Write summary header
-    summary_out << "# ICOW C++ Reference Outputs (Debugged Version)\n";
-    summary_out << "# Generated from debugged C++ code with 8 bug fixes applied\n";
-    summary_out << "# See header of icow_debugged.cpp and _background/equations.md for full details\n";
-    summary_out << "# Bug Fix 5: CitySlope = CEC/CityLength (terrain grade)\n";
-    summary_out << "# Bug Fix 8: Don't set rh=0 when B<minHeight (allows resistance-only)\n\n";
+// parameters passed at run time
+struct RuntimeCity {
+    const CityParams & city;
+    explicit RuntimeCity(const CityParams & c) : city(c) {}
+    const CityParams & get() const { return city; }
+};
 
-    // Process each test case
-    for (const auto& tc : test_cases) {
-        double cityChar[27];
-        memset(cityChar, 0, sizeof(cityChar));
+// parameters baked in as a template argument
+template <const CityParams & city>
+struct FixedCity {
+    const CityParams & get() const { return city; }
+};
 
-        // Call CharacterizeCity to compute all costs and zone values
-        CharacterizeCity(tc.W, tc.B, tc.R, tc.P, tc.D, cityChar);
+// output columns of the batched kernel at either precision; CityColumns is the double one
+template <class Real>
+struct CityColumnsOf {
+    int * caseNum;
+    Real * wc, * rc, * dc, * tic, * tc;
+    Real * vz1, * vz2, * vz3, * vz4;
+    Real * tz1, * tz2, * tz3, * tz4;
+};
 
-        // === Write costs output ===
-        costs_out << "# Test Case: " << tc.name << "\n";
-        costs_out << "# Levers: W=" << tc.W << ", R=" << tc.R << ", P=" << tc.P
-                  << ", D=" << tc.D << ", B=" << tc.B << "\n";
-        costs_out << "withdrawal_cost: " << cityChar[22] << "\n";  // wc
-        costs_out << "value_after_withdrawal: " << cityChar[17] << "\n";  // tcvaw
-        costs_out << "resistance_cost: " << cityChar[23] << "\n";  // rc
-        costs_out << "dike_cost: " << cityChar[21] << "\n";  // dc
-        costs_out << "total_investment_cost: " << cityChar[24] << "\n\n";  // tic
+inline CityColumnsOf<double> ColumnsOf(CityColumns c) {
+    CityColumnsOf<double> out = {c.caseNum, c.wc, c.rc, c.dc, c.tic, c.tc, c.vz1, c.vz2, c.vz3, c.vz4, c.tz1, c.tz2, c.tz3, c.tz4};
+    return out;
+}
 
-        // === Write zone geometry output ===
-        zones_out << "# Test Case: " << tc.name << "\n";
-        zones_out << "# Levers: W=" << tc.W << ", R=" << tc.R << ", P=" << tc.P
-                  << ", D=" << tc.D << ", B=" << tc.B << "\n";
-        zones_out << "case_number: " << (int)cityChar[0] << "\n";  // caseNum
-        zones_out << "zone1_value: " << cityChar[6] << "\n";  // vz1
-        zones_out << "zone2_value: " << cityChar[7] << "\n";  // vz2
-        zones_out << "zone3_value: " << cityChar[8] << "\n";  // vz3
-        zones_out << "zone4_value: " << cityChar[9] << "\n";  // vz4
-        zones_out << "zone1_top: " << cityChar[10] << "\n";  // tz1
-        zones_out << "zone2_top: " << cityChar[11] << "\n";  // tz2
-        zones_out << "zone3_top: " << cityChar[12] << "\n";  // tz3
-        zones_out << "zone4_top: " << cityChar[13] << "\n\n";  // tz4
+inline CityColumnsOf<float> ColumnsOf(CityColumnsFloat c) {
+    CityColumnsOf<float> out = {c.caseNum, c.wc, c.rc, c.dc, c.tic, c.tc, c.vz1, c.vz2, c.vz3, c.vz4, c.tz1, c.tz2, c.tz3, c.tz4};
+    return out;
+}
+
+// Branch-free batched CharacterizeCity over an arbitrary city parameter set. City is either
+// RuntimeCity (parameters read from memory) or FixedCity<params> (parameters are compile-time
+// constants the optimizer folds into the loop). Results are the same for both.
+// Real is double, or float for screening sweeps at twice the SIMD width. In float, the city value
+// lost (tcvi - fcv) is computed directly rather than by cancelling against TotalCityValueInitial,
+// and the dike cost is evaluated in double and rounded once; see FloatModeError for the accuracy.
+template <class Real, class City>
+void CharacterizeCityColumns (City select, const DikeCostParams * dike, const DikeCostTable * table, DikeCostCache * dikeCache,
+                              int n,const Real * W,const Real * B,const Real * R,const Real * P,const Real * D, CityColumnsOf<Real> out) {
+    // The case tree and the switch of CharacterizeCity are replaced by selects so the first loop
+    // vectorizes (AVX2/AVX-512/NEON, whatever -march provides). Every expression is written exactly as in
+    // CharacterizeCity so results are bit-identical, unless a dike cost table is given (a NULL table means exact).
+    // A dike cost cache, used when there is no table, must have been initialized with dike.
+    const CityParams & city = select.get();
+    const bool reduced = sizeof(Real) < sizeof(double);
+    const Real baseValue = city.baseValue, minHeight = city.minHeight, CEC = city.CEC;
+    const Real TotalCityValueInitial = city.TotalCityValueInitial;
+    const Real WithdrawelCostFactor = city.WithdrawelCostFactor, WithdrawelPercentLost = city.WithdrawelPercentLost;
+    const Real DikeUnprotectedValuationRatio = city.DikeUnprotectedValuationRatio, ProtectedValueRatio = city.ProtectedValueRatio;
+    const Real resistanceAdjustment = city.resistanceAdjustment, resistanceExponentialFactor = city.resistanceExponentialFactor;
+    const Real resistanceExponentialThreshold = city.resistanceExponentialThreshold, resistanceLinearFactor = city.resistanceLinearFactor;
+    const Real Basement = city.Basement, BH = city.BH;
+    const Real zero = 0, one = 1;
+
+    // pass 1: everything except the dike cost; fcv (the value lost in float) is parked in tc until pass 2
+    #pragma omp simd
+    for (int i=0; i<n; i++) {
+        // effective levers, same rules as CharacterizeCity; inputs are loaded unconditionally
+        // and every mask is built straight from input comparisons (selects of masks don't vectorize)
+        Real Wi = W[i], Bi = B[i], Ri = R[i], Pi = P[i], Di = D[i];
+        bool noR = (Ri==baseValue) | (Ri<minHeight);
+        bool noB = (Bi<minHeight) | (Bi==baseValue);
+        bool isDBase = (Di==baseValue);
+        // dike without a setback forces rh=0 (dbh is already 0 whenever noB holds)
+        bool tooClose = !isDBase & (Di>=minHeight) & noB & !noR;
+        bool hasD = !isDBase & (Di>0);
+        bool hasB = !noB;
+        bool hasR = !noR & !tooClose;
+        Real whi = (Wi==baseValue) ? zero : Wi;
+        Real rhi = hasR ? Ri : zero;
+        Real rpi = noR ? Real(0.5) : Pi;
+        Real dhi = isDBase ? zero : Di;
+        Real dbhi = noB ? zero : Bi;
+
+        // case masks, one per leaf of the decision tree in CharacterizeCity
+        bool rBelowB = (Ri<Bi);
+        bool c1 = hasD & hasB & hasR & rBelowB;
+        bool c2 = hasD & hasB & hasR & !rBelowB;
+        bool c3 = hasD & hasB & !hasR;
+        bool c4 = hasD & !hasB;
+        bool c5 = !hasD & hasB & hasR & rBelowB;
+        bool c6 = !hasD & hasB & hasR & !rBelowB;
+        bool c7 = !hasD & hasB & !hasR;
+        bool c8 = !hasD & !hasB & hasR;
+        bool c9 = !hasD & !hasB & !hasR;
+        // c=1..9 in the lane width of everything else
+        Real caseValue = Real(1)*c1 + Real(2)*c2 + Real(3)*c3 + Real(4)*c4 + Real(5)*c5 + Real(6)*c6 + Real(7)*c7 + Real(8)*c8 + Real(9)*c9;
+
+        // every candidate value is computed unconditionally so the selects below need no branches;
+        // lanes that don't use a candidate may hold inf/nan there, which is never selected
+        Real tcvi_ = TotalCityValueInitial;
+        Real wcAny = tcvi_*whi/(CEC-whi)*WithdrawelCostFactor;
+        Real tcvaw_ = tcvi_*(one - WithdrawelPercentLost*whi/CEC);
+        Real unprotR = tcvaw_*DikeUnprotectedValuationRatio*rhi/(CEC-whi);
+        Real unprotB = tcvaw_*DikeUnprotectedValuationRatio*dbhi/(CEC-whi);
+        Real unprotBR = tcvaw_*DikeUnprotectedValuationRatio*(dbhi-rhi)/(CEC-whi);
+        Real resistR = tcvaw_*rhi/(CEC-whi);
+        Real protD = tcvaw_*ProtectedValueRatio*dhi/(CEC-whi);
+        Real aboveBD = tcvaw_*(CEC-whi-dbhi-dhi)/(CEC-whi);
+        Real aboveD = tcvaw_*(CEC-whi-dhi)/(CEC-whi);
+        Real aboveB = tcvaw_*(CEC-whi-dbhi)/(CEC-whi);
+        Real aboveR = tcvaw_*(CEC-whi-rhi)/(CEC-whi);
+        // 1-rp is exact for rp in [0.5, 1] at either precision (Sterbenz), so 1/(1-rp) adds one rounding
+        Real fcR = resistanceAdjustment*(resistanceExponentialFactor*std::max(zero,(rpi-resistanceExponentialThreshold))/(one-rpi) +
+                   rpi*resistanceLinearFactor);
+        Real rc1 = tcvaw_ * fcR * rhi * (rhi/2 + Basement) / (BH * (CEC - whi));   // CalculateResiliencyCost1
+        Real rc2 = tcvaw_ * fcR * dbhi * (rhi - dbhi/2 + Basement) / (BH * (CEC - whi)); // CalculateResiliencyCost2
+
+        // chained two-way selects, applied in order so the later (more specific) ones win;
+        // nested ?: chains would defeat if-conversion
+        Real wc_ = (whi==0) ? zero : wcAny;
+        Real vz1_ = c8 ? resistR : zero;
+        vz1_ = (c2|c6) ? unprotB : vz1_;
+        vz1_ = (c1|c5) ? unprotR : vz1_;
+        Real vz2_ = (c3|c7) ? unprotB : zero;
+        vz2_ = (c1|c5) ? unprotBR : vz2_;
+        Real vz3_ = (c1|c2|c3|c4) ? protD : zero;
+        Real vz4_ = c8 ? aboveR : tcvaw_;
+        vz4_ = (c5|c6|c7) ? aboveB : vz4_;
+        vz4_ = c4 ? aboveD : vz4_;
+        vz4_ = (c1|c2|c3) ? aboveBD : vz4_;
+        // case 2 leaves vz1 out of the final city value; adding the zero terms is exact
+        Real fcv_ = (c2 ? zero : vz1_)+vz2_+vz3_+vz4_;
+        if (reduced) {
+            // tcvi - fcv without the cancellation: withdrawal loses tcvi*WithdrawelPercentLost*wh/CEC, and of
+            // the rest the setback loses (1-DikeUnprotectedValuationRatio)*dbh (all of dbh in case 2, which
+            // leaves vz1 out) and the dike (1-ProtectedValueRatio)*dh, as fractions of CEC-wh
+            Real lostB = c2 ? dbhi : (one-DikeUnprotectedValuationRatio)*dbhi;
+            Real lostD = (one-ProtectedValueRatio)*dhi;
+            Real lostZones = (hasB ? lostB : zero) + (hasD ? lostD : zero);
+            fcv_ = tcvi_*WithdrawelPercentLost*whi/CEC + tcvaw_*lostZones/(CEC-whi);
+        }
+
+        Real tz1_ = (c2|c6) ? whi+dbhi : whi;
+        tz1_ = (c1|c5|c8) ? whi+rhi : tz1_;
+        Real tz2_ = (c4|c9) ? whi : whi+dbhi;
+        tz2_ = c8 ? whi+rhi : tz2_;
+        Real tz3_ = c9 ? whi : whi+dbhi;
+        tz3_ = c8 ? whi+rhi : tz3_;
+        tz3_ = c4 ? whi+dhi : tz3_;
+        tz3_ = (c1|c2|c3) ? whi+dbhi+dhi : tz3_;
+        Real rc_ = (c2|c6) ? rc2 : zero;
+        rc_ = (c1|c5|c8) ? rc1 : rc_;
+
+        out.caseNum[i] = (int)caseValue;
+        out.wc[i]  = wc_;
+        out.rc[i]  = rc_;
+        out.dc[i]  = dhi;  // dike height, replaced by the dike cost in pass 2
+        out.tc[i]  = fcv_;
+        out.vz1[i] = vz1_;
+        out.vz2[i] = vz2_;
+        out.vz3[i] = vz3_;
+        out.vz4[i] = vz4_;
+        out.tz1[i] = tz1_;
+        out.tz2[i] = tz2_;
+        out.tz3[i] = tz3_;
+        out.tz4[i] = CEC;
     }
 
-    costs_out.close();
-    zones_out.close();
-    summary_out.close();
+    // pass 2: dike cost (cases 1-5 and 7 build a dike, even of zero height) and the totals
+    for (int i=0; i<n; i++) {
+        int c = out.caseNum[i];
+        bool buildsDike = (c<=5 || c==7);
+        double hd = out.dc[i];
+        double dcExact = !buildsDike ? 0 : table ? DikeCostFromTable(hd,table,dike) :
+                         dikeCache ? CachedDikeCost(hd,dikeCache) : CalculateDikeCostPrepared(hd,dike);
+        Real dc_ = (Real)dcExact;
+        Real tic_ = out.wc[i]+dc_+out.rc[i];
+        out.dc[i]  = dc_;
+        out.tic[i] = tic_;
+        if (reduced) {
+            Real lost = out.tc[i];
+            out.tc[i] = (c==9) ? lost : tic_-lost;
+        } else {
+            Real fcv_ = out.tc[i];
+            out.tc[i] = (c==9) ? TotalCityValueInitial-fcv_ : tic_+fcv_-TotalCityValueInitial;
+        }
+    }
+}
 
-    cout << "Test outputs generated successfully in outputs/ directory!\n";
-    cout << "Files created:\n";
-    cout << "  - outputs/costs.txt\n";
-    cout << "  - outputs/zones.txt\n";
-    cout << "  - outputs/summary.txt\n";
+
+extern "C" {
+
+    void CharacterizeCityBatchForCity (const CityParams * city, const DikeCostParams * dike, const DikeCostTable * table,
+                                       int n,const double * W,const double * B,const double * R,const double * P,const double * D, CityColumns out) {
+        CharacterizeCityColumns(RuntimeCity(*city),dike,table,NULL,n,W,B,R,P,D,ColumnsOf(out));
+    }
+
+    void CharacterizeCityBatchWithDikeTable (int n,const double * W,const double * B,const double * R,const double * P,const double * D, CityColumns out, const DikeCostTable * table) {
+        CharacterizeCityColumns(FixedCity<productionCity>(),&cityDikeCost,table,NULL,n,W,B,R,P,D,ColumnsOf(out));
+    }
+
+    // exact dike costs memoized in dikeCache, which must have been initialized with cityDikeCost
+    void CharacterizeCityBatchWithDikeCache (int n,const double * W,const double * B,const double * R,const double * P,const double * D, CityColumns out, DikeCostCache * dikeCache) {
+        CharacterizeCityColumns(FixedCity<productionCity>(),&cityDikeCost,NULL,dikeCache,n,W,B,R,P,D,ColumnsOf(out));
+    }
+
+    void CharacterizeCityBatchBranchFree (int n,const double * W,const double * B,const double * R,const double * P,const double * D, CityColumns out) {
+        CharacterizeCityBatchWithDikeTable(n,W,B,R,P,D,out,NULL);
+    }
+
+    // the branch-free batch in single precision, for screening; dike costs are exact, rounded to float
+    void CharacterizeCityBatchFloat (int n,const float * W,const float * B,const float * R,const float * P,const float * D, CityColumnsFloat out) {
+        CharacterizeCityColumns(FixedCity<productionCity>(),&cityDikeCost,NULL,NULL,n,W,B,R,P,D,ColumnsOf(out));
+    }
+
+} // extern "C"
+
+
+// ========================================
+// EXPECTED ANNUAL DAMAGE
+// ========================================
+
+// 15-point Kronrod rule on [-1,1] with its embedded 7-point Gauss rule (the Gauss nodes are the
+// odd-numbered Kronrod nodes); nodes are the non-negative half, symmetric about 0
+const double kronrodNodes[8] = {0.991455371120812639206854697526329, 0.949107912342758524526189684047851,
+                                0.864864423359769072789712788640926, 0.741531185599394439863864773280788,
+                                0.586087235467691130294144845693013, 0.405845151377397166906606412076961,
+                                0.207784955007898467600689403773245, 0.000000000000000000000000000000000};
+const double kronrodWeights[8] = {0.022935322010529224963732008058970, 0.063092092629978553290700663189204,
+                                  0.104790010322250183839876322541518, 0.140653259715525918745189590510238,
+                                  0.169004726639267902826583426598550, 0.190350578064785409913256402421014,
+                                  0.204432940075298892414161999234649, 0.209482141084727828012999174891714};
+const double gaussWeights[4] = {0.129484966168869693270611432679082, 0.279705391489276667901467771423780,
+                                0.381830050505118944950369775488975, 0.417959183673469387755102040816327};
+
+const int maxQuadratureSegments = 2000;
+
+struct QuadratureSegment {
+    double a, b, integral, error;
+    bool operator<(const QuadratureSegment& o) const { return error < o.error; }
+};
+
+template <class F>
+QuadratureSegment KronrodSegment(const F& f, double a, double b) {
+    double center = (a + b) / 2, half = (b - a) / 2;
+    double fc = f(center);
+    double kronrod = fc * kronrodWeights[7], gauss = fc * gaussWeights[3];
+    for (int k = 0; k < 7; k++) {
+        double fx = f(center - half * kronrodNodes[k]) + f(center + half * kronrodNodes[k]);
+        kronrod += kronrodWeights[k] * fx;
+        if (k % 2 == 1) gauss += gaussWeights[k / 2] * fx;
+    }
+    QuadratureSegment s = {a, b, kronrod * half, fabs((kronrod - gauss) * half)};
+    return s;
+}
+
+// Integrate f over the intervals between consecutive breaks (sorted) by adaptive Gauss-Kronrod:
+// like QuadGK, the segment with the largest error estimate is bisected until the total error is
+// below atol or rtol times the integral. Place breaks at the kinks and jumps of f.
+template <class F>
+double AdaptiveGaussKronrod(const F& f, const vector<double>& breaks, double rtol, double atol = 0) {
+    vector<QuadratureSegment> heap;
+    for (size_t k = 1; k < breaks.size(); k++) {
+        if (breaks[k] > breaks[k-1]) heap.push_back(KronrodSegment(f, breaks[k-1], breaks[k]));
+    }
+    std::make_heap(heap.begin(), heap.end());
+    while (!heap.empty() && (int)heap.size() < maxQuadratureSegments) {
+        double integral = 0, error = 0;
+        for (const auto& s : heap) { integral += s.integral; error += s.error; }
+        if (error <= std::max(atol, rtol * fabs(integral))) break;
+        std::pop_heap(heap.begin(), heap.end());
+        QuadratureSegment worst = heap.back();
+        heap.pop_back();
+        double mid = (worst.a + worst.b) / 2;
+        heap.push_back(KronrodSegment(f, worst.a, mid));
+        std::push_heap(heap.begin(), heap.end());
+        heap.push_back(KronrodSegment(f, mid, worst.b));
+        std::push_heap(heap.begin(), heap.end());
+    }
+    double integral = 0;
+    for (const auto& s : heap) integral += s.integral;
+    return integral;
+}
+
+// raw surge at which the effective surge reaches height z, if inside [hMin, hMax]
+void AddSurgeBreak(vector<double>& breaks, double z, double hMin, double hMax) {
+    double h = (z + Seawall) / runUpWave;
+    if (h > hMin && h < hMax) breaks.push_back(h);
+}
+
+// Integration range and breaks shared by a strategy's integrals: the range is the
+// 0.0001..0.9999 quantiles of the surge distribution, as in _integrate_expected_damage
+struct EadRange {
+    SurgeGenerator gev;  // only loc, scale and shape are used
+    double hMin, hMax;
+};
+
+EadRange MakeEadRange(const SurgeGenerator& gev) {
+    EadRange r = {gev, GevQuantile(&gev, 0.0001), GevQuantile(&gev, 0.9999)};
+    return r;
+}
+
+// breaks at the seawall (where the effective surge jumps from 0) and at the effective surge
+// heights zs, sorted, with the range ends
+vector<double> SurgeBreaks(const EadRange& range, const double * zs, int n) {
+    vector<double> breaks = {range.hMin, range.hMax};
+    if (Seawall > range.hMin && Seawall < range.hMax) breaks.push_back(Seawall);
+    for (int k = 0; k < n; k++) AddSurgeBreak(breaks, zs[k], range.hMin, range.hMax);
+    std::sort(breaks.begin(), breaks.end());
+    return breaks;
+}
+
+// the dike base and the start and end of the failure ramp, as effective surge heights
+void DikeBreakHeights(double base, double D, double * zs) {
+    zs[0] = base;
+    zs[1] = base + pfThreshold * D;
+    zs[2] = base + D;
+}
+
+// total zone damage at surge h with the dike intact and failed, before the threshold penalty
+// (the dvz1..dvz4 sum of CalculateDamage, without the other entries)
+inline void ZoneDamageTotals(const double * cityChar, double h, double * intact, double * failed) {
+    double hs = EffectiveSurge(h);
+    double z1 = BaseZoneDamage(cityChar[wh], cityChar[tz1], cityChar[vz1], hs) * cityChar[dtr];
+    double z2 = BaseZoneDamage(cityChar[tz1], cityChar[tz2], cityChar[vz2], hs);
+    double z3 = BaseZoneDamage(cityChar[tz2], cityChar[tz3], cityChar[vz3], hs);
+    double z4 = BaseZoneDamage(cityChar[tz3], cityChar[tz4], cityChar[vz4], hs);
+    *intact = z1 + z2 + z3 * intactDikeDamageFactor + z4;
+    *failed = z1 + z2 + z3 * FailedDikeDamageFactor + z4;
+}
+
+inline double ZoneDamageTotal(const double * cityChar, double h, int dikeFailed) {
+    double intact, failed;
+    ZoneDamageTotals(cityChar, h, &intact, &failed);
+    return dikeFailed ? failed : intact;
+}
+
+// smallest surge in [lo, hi] at which damage(h) exceeds threshold, for damage non-decreasing in h
+template <class F>
+double ThresholdCrossing(const F& damage, double lo, double hi) {
+    if (damage(lo) > threshold) return lo;
+    for (int k = 0; k < 100 && hi - lo > 1e-12 * std::max(1.0, fabs(hi)); k++) {
+        double mid = (lo + hi) / 2;
+        if (damage(mid) > threshold) hi = mid; else lo = mid;
+    }
+    return hi;
+}
+
+// Surges at which the total zone damage with the dike failed and intact first exceeds the
+// threshold (range.hMax if it never does); the failed total is the larger, so it crosses first.
+// The penalty starts there with an unbounded second derivative, so these are quadrature breaks.
+void ThresholdCrossings(const double * cityChar, const EadRange& range, double * hFailed, double * hIntact) {
+    *hFailed = *hIntact = range.hMax;
+    if (ZoneDamageTotal(cityChar, range.hMax, 1) <= threshold) return;
+    *hFailed = ThresholdCrossing([&](double h) { return ZoneDamageTotal(cityChar, h, 1); }, range.hMin, range.hMax);
+    if (ZoneDamageTotal(cityChar, range.hMax, 0) <= threshold) return;
+    *hIntact = ThresholdCrossing([&](double h) { return ZoneDamageTotal(cityChar, h, 0); }, *hFailed, range.hMax);
+}
+
+// all breaks of a strategy's expected damage in range: zone boundaries, dike ramp and the
+// threshold crossings hFailed, hIntact from ThresholdCrossings
+vector<double> StrategyBreaks(const double * cityChar, const EadRange& range, double hFailed, double hIntact) {
+    double zs[8] = {cityChar[wh], cityChar[tz1], cityChar[tz2], cityChar[tz3], cityChar[tz4]};
+    DikeBreakHeights(cityChar[wh] + cityChar[dbh], cityChar[dh], zs + 5);
+    vector<double> breaks = SurgeBreaks(range, zs, 8);
+    for (double h : {hFailed, hIntact}) if (h > range.hMin && h < range.hMax) breaks.push_back(h);
+    std::sort(breaks.begin(), breaks.end());
+    return breaks;
+}
+
+// expected annual damage by integrating ExpectedDamageGivenSurge against the surge density,
+// the direct counterpart of _integrate_expected_damage with a QuadratureIntegrator
+double ExpectedAnnualDamageDirect(const double * cityChar, const EadRange& range, double rtol) {
+    double hFailed, hIntact;
+    ThresholdCrossings(cityChar, range, &hFailed, &hIntact);
+    vector<double> breaks = StrategyBreaks(cityChar, range, hFailed, hIntact);
+    return AdaptiveGaussKronrod([&](double h) { return GevPdf(&range.gev, h) * ExpectedDamageGivenSurge(cityChar, h); },
+                                breaks, rtol);
+}
+
+// Integrals of the zone damages per unit zone value, for one surge distribution. Zone damage is
+// linear in the zone value, so strategies with the same zone boundaries (and, for zone 3, the
+// same dike) share these integrals and only the threshold penalty is integrated per strategy.
+// Not thread-safe: use one cache per thread.
+struct EadZoneCache {
+    EadRange range;
+    double rtol;
+    std::map<std::array<double, 5>, double> integrals;  // (zone, zLow, zHigh, dike base, D)
+    int64_t hits, misses;
+};
+
+EadZoneCache MakeEadZoneCache(const SurgeGenerator& gev, double rtol) {
+    EadZoneCache cache = {MakeEadRange(gev), rtol, {}, 0, 0};
+    return cache;
+}
+
+// integral of pdf * zone damage for a zone of unit value; zone 3 includes the dike factor
+// averaged over failure, zone 1 excludes the resistance factor
+double ZoneDamageIntegral(EadZoneCache * cache, int zone, double zLow, double zHigh, double base, double D) {
+    if (zone != 3) base = D = 0;
+    std::array<double, 5> key = {(double)zone, zLow, zHigh, base, D};
+    auto found = cache->integrals.find(key);
+    if (found != cache->integrals.end()) {
+        cache->hits++;
+        return found->second;
+    }
+    cache->misses++;
+    const SurgeGenerator * gev = &cache->range.gev;
+    double zs[5] = {zLow, zHigh};
+    double integral;
+    if (zone == 3) {
+        DikeBreakHeights(base, D, zs + 2);
+        integral = AdaptiveGaussKronrod([&](double h) {
+            double hs = EffectiveSurge(h);
+            double pFail = DikeFailureProbability(std::max(0.0, hs - base), D);
+            double factor = pFail * FailedDikeDamageFactor + (1 - pFail) * intactDikeDamageFactor;
+            return GevPdf(gev, h) * BaseZoneDamage(zLow, zHigh, 1.0, hs) * factor;
+        }, SurgeBreaks(cache->range, zs, 5), cache->rtol);
+    } else {
+        integral = AdaptiveGaussKronrod([&](double h) {
+            return GevPdf(gev, h) * BaseZoneDamage(zLow, zHigh, 1.0, EffectiveSurge(h));
+        }, SurgeBreaks(cache->range, zs, 2), cache->rtol);
+    }
+    cache->integrals[key] = integral;
+    return integral;
+}
+
+// Expected annual damage of one strategy from the cached zone integrals plus the threshold
+// penalty, which is nonlinear in the total and integrated only where the total (with the dike
+// failed, the larger one) exceeds the threshold.
+double ExpectedAnnualDamage(const double * cityChar, EadZoneCache * cache) {
+    const double lows[5] = {0, cityChar[wh], cityChar[tz1], cityChar[tz2], cityChar[tz3]};
+    const double highs[5] = {0, cityChar[tz1], cityChar[tz2], cityChar[tz3], cityChar[tz4]};
+    const double values[5] = {0, cityChar[vz1], cityChar[vz2], cityChar[vz3], cityChar[vz4]};
+    double base = cityChar[wh] + cityChar[dbh], D = cityChar[dh];
+    double ead = 0;
+    for (int zone = 1; zone <= 4; zone++) {
+        if (values[zone] <= 0) continue;
+        double integral = ZoneDamageIntegral(cache, zone, lows[zone], highs[zone], base, D);
+        ead += values[zone] * integral * (zone == 1 ? cityChar[dtr] : 1.0);
+    }
+
+    const EadRange& range = cache->range;
+    double hFailed, hIntact;
+    ThresholdCrossings(cityChar, range, &hFailed, &hIntact);
+    if (hFailed >= range.hMax) return ead;
+    EadRange penaltyRange = {range.gev, hFailed, range.hMax};
+    vector<double> breaks = StrategyBreaks(cityChar, penaltyRange, hFailed, hIntact);
+    // the zone integrals already hold rtol of the linear part, so that is the penalty's error budget
+    ead += AdaptiveGaussKronrod([&](double h) {
+        double pFail = DikeFailureProbability(SurgeAtDike(cityChar, h), D);
+        double intact, failed;
+        ZoneDamageTotals(cityChar, h, &intact, &failed);
+        return GevPdf(&range.gev, h) * (pFail * ThresholdPenalty(failed) + (1 - pFail) * ThresholdPenalty(intact));
+    }, breaks, cache->rtol, cache->rtol * ead);
+    return ead;
+}
+
+
+// ========================================
+// PARALLEL SURGE GENERATION
+// ========================================
+
+// GenerateSurges over all sequences of a block on numThreads threads (0: one per hardware
+// thread), each thread filling a contiguous range of sequences. The buffer is the same for
+// every thread count.
+void GenerateSurgesParallel(const SurgeGenerator * gen, uint64_t firstSequence, double * surge,
+                            int numSequences, int numYears, int layout, int numThreads) {
+    if (numThreads <= 0) numThreads = std::max(1u, std::thread::hardware_concurrency());
+    numThreads = std::min(numThreads, std::max(numSequences, 1));
+    vector<std::thread> threads;
+    for (int t = 1; t < numThreads; t++) {
+        threads.emplace_back(GenerateSurges, gen, firstSequence, surge, numSequences, numYears, layout,
+                             (int)((int64_t)numSequences * t / numThreads), (int)((int64_t)numSequences * (t + 1) / numThreads));
+    }
+    GenerateSurges(gen, firstSequence, surge, numSequences, numYears, layout, 0, numSequences / numThreads);
+    for (auto& th : threads) th.join();
+}
+
+
+// ========================================
+// SURGE SAMPLING
+// ========================================
+
+// Estimates of the expected annual damage (what ExpectedAnnualDamage integrates) from a sample of
+// annual surges, with a standard error per strategy. Dike failure is averaged analytically at
+// each surge, as in ExpectedDamageGivenSurge, so a sample point is one uniform u taken through
+// GevQuantile and the designs differ only in where the u fall:
+//   plain       independent Philox uniforms, the MonteCarloIntegrator of src/EAD
+//   antithetic  pairs u, 1-u
+//   quasi       van der Corput points (the one-dimensional Sobol and Halton sequence) under
+//               independent random digital shifts, one point set per replicate
+//   stratified  equal counts in the return period strata of returnPeriodStrata
+//   importance  a defensive mixture drawing tailShare of the points above the 1-tailProbability quantile
+const int plainSampling = 0;
+const int antitheticSampling = 1;
+const int quasiSampling = 2;
+const int stratifiedSampling = 3;
+const int importanceSampling = 4;
+const int numSamplingModes = 5;
+const char * const samplingModeNames[numSamplingModes] = {"plain", "antithetic", "quasi", "stratified", "importance"};
+
+const uint32_t samplingStream = 4;
+
+// stratum bounds as return periods in years: u in [0, 1-1/2), [1-1/2, 1-1/10), ..., [1-1/10000, 1)
+const int numStrata = 6;
+const double returnPeriodStrata[numStrata - 1] = {2, 10, 100, 1000, 10000};
+
+// largest uniform below 1, so GevQuantile stays finite at the top of a stratum or tail
+const double maxSampleUniform = 1 - 1.0 / 9007199254740992.0;
+
+struct SamplingOptions {
+    int mode;
+    int64_t numEvents;        // rounded down to whole pairs, replicates or strata
+    uint64_t seed;
+    int replicates;           // quasi: shifted point sets
+    double tailProbability;   // importance: the tail is u >= 1-tailProbability
+    double tailShare;         // importance: fraction of the points drawn from the tail
+};
+
+SamplingOptions DefaultSamplingOptions(int mode, int64_t numEvents, uint64_t seed) {
+    SamplingOptions options = {mode, numEvents, seed, 16, 0.01, 0.5};
+    return options;
+}
+
+// Annual surges shared by every strategy: surge[i] has likelihood ratio weight[i] (1 except for
+// importance sampling) and belongs to group[i]. For stratified sampling the groups are the strata,
+// with probability groupProbability; otherwise they are independent replicates (single events,
+// antithetic pairs or shifted point sets) whose means are averaged.
+struct SurgeSample {
+    int mode;
+    vector<double> surge, weight;
+    vector<int> group;
+    vector<double> groupProbability;
+    int numGroups;
+};
+
+// per-strategy estimate with standard errors
+struct DamageEstimate {
+    double damage;                // expected annual damage
+    double damageError;
+    double thresholdProbability;  // probability of a dvTE event per year
+    double thresholdError;
+    int64_t events;
+};
+
+inline uint64_t BitReverse64(uint64_t x) {
+    x = ((x >> 1) & 0x5555555555555555ull) | ((x & 0x5555555555555555ull) << 1);
+    x = ((x >> 2) & 0x3333333333333333ull) | ((x & 0x3333333333333333ull) << 2);
+    x = ((x >> 4) & 0x0F0F0F0F0F0F0F0Full) | ((x & 0x0F0F0F0F0F0F0F0Full) << 4);
+    x = ((x >> 8) & 0x00FF00FF00FF00FFull) | ((x & 0x00FF00FF00FF00FFull) << 8);
+    x = ((x >> 16) & 0x0000FFFF0000FFFFull) | ((x & 0x0000FFFF0000FFFFull) << 16);
+    return (x >> 32) | (x << 32);
+}
+
+// Draw the annual surges of one sampling design into *out. Every point depends only on the seed
+// and its index, like the surge blocks. Fails when the design is too small for SampleMean to
+// estimate a standard error: two points per stratum, or two replicates with points in each.
+bool MakeSurgeSample(const SurgeGenerator * gen, const SamplingOptions& options, SurgeSample * out) {
+    int mode = options.mode;
+    int64_t n = options.numEvents;
+    if (mode == antitheticSampling) n -= n % 2;
+    if (mode == quasiSampling && options.replicates > 0) n -= n % options.replicates;
+    if (mode == stratifiedSampling) n -= n % numStrata;
+    bool enough = (mode == stratifiedSampling) ? n >= 2 * numStrata
+                : (mode == antitheticSampling) ? n >= 4
+                : (mode == quasiSampling) ? options.replicates >= 2 && n >= options.replicates
+                : n >= 2;
+    if (!enough) {
+        cerr << "Too few events (" << options.numEvents << ") for a standard error from "
+             << samplingModeNames[mode] << " sampling\n";
+        return false;
+    }
+    SurgeSample& sample = *out;
+    sample = SurgeSample();
+    sample.mode = mode;
+    sample.surge.resize(n);
+    sample.weight.assign(n, 1.0);
+    sample.group.resize(n);
+    vector<double> u(n);
+    double u0, u1;
+    if (mode == antitheticSampling) {
+        for (int64_t p = 0; p < n / 2; p++) {
+            CounterUniforms(options.seed, samplingStream, p, 0, &u0, &u1);
+            u[2 * p] = u0;
+            u[2 * p + 1] = 1 - u0;
+            sample.group[2 * p] = sample.group[2 * p + 1] = (int)p;
+        }
+        sample.numGroups = (int)(n / 2);
+    } else if (mode == quasiSampling) {
+        int64_t m = n / options.replicates;
+        uint32_t k0 = (uint32_t)options.seed, k1 = (uint32_t)(options.seed >> 32);
+        for (int r = 0; r < options.replicates; r++) {
+            uint32_t c0 = 0, c1 = r, c2 = samplingStream << 16, c3 = 0;
+            Philox4x32(c0, c1, c2, c3, k0, k1);
+            uint64_t shift = ((uint64_t)c0 << 32) | c1;
+            for (int64_t k = 0; k < m; k++) {
+                uint64_t x = BitReverse64((uint64_t)k) ^ shift;
+                u[r * m + k] = ((double)(x >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+                sample.group[r * m + k] = r;
+            }
+        }
+        sample.numGroups = options.replicates;
+    } else if (mode == stratifiedSampling) {
+        int64_t m = n / numStrata;
+        for (int k = 0; k < numStrata; k++) {
+            double lo = (k == 0) ? 0.0 : 1 - 1 / returnPeriodStrata[k - 1];
+            double hi = (k == numStrata - 1) ? 1.0 : 1 - 1 / returnPeriodStrata[k];
+            sample.groupProbability.push_back(hi - lo);
+            for (int64_t j = 0; j < m; j++) {
+                CounterUniforms(options.seed, samplingStream, k * m + j, 0, &u0, &u1);
+                u[k * m + j] = std::min(lo + (hi - lo) * u0, maxSampleUniform);
+                sample.group[k * m + j] = k;
+            }
+        }
+        sample.numGroups = numStrata;
+    } else {
+        // plain, or importance with density (1-tailShare) + tailShare/tailProbability on the tail
+        double tail = options.tailProbability, share = (mode == importanceSampling) ? options.tailShare : 0.0;
+        for (int64_t i = 0; i < n; i++) {
+            CounterUniforms(options.seed, samplingStream, i, 0, &u0, &u1);
+            u[i] = (u1 < share) ? std::min(1 - tail + tail * u0, maxSampleUniform) : u0;
+            if (mode == importanceSampling) sample.weight[i] = 1 / ((1 - share) + (u[i] >= 1 - tail ? share / tail : 0.0));
+            sample.group[i] = (int)i;
+        }
+        sample.numGroups = (int)n;
+    }
+    for (int64_t i = 0; i < n; i++) sample.surge[i] = GevQuantile(gen, u[i]);
+    return true;
+}
+
+// mean and standard error of per-point values y under the groups of sample
+void SampleMean(const vector<double>& y, const SurgeSample& sample, double * mean, double * error) {
+    int G = sample.numGroups;
+    vector<double> groupMean(G, 0.0), count(G, 0.0), deviation(G, 0.0);
+    for (size_t i = 0; i < y.size(); i++) {
+        groupMean[sample.group[i]] += y[i];
+        count[sample.group[i]] += 1;
+    }
+    for (int g = 0; g < G; g++) groupMean[g] /= count[g];
+    double m = 0, variance = 0;
+    if (sample.mode == stratifiedSampling) {
+        for (size_t i = 0; i < y.size(); i++) {
+            double d = y[i] - groupMean[sample.group[i]];
+            deviation[sample.group[i]] += d * d;
+        }
+        for (int g = 0; g < G; g++) {
+            double p = sample.groupProbability[g];
+            m += p * groupMean[g];
+            variance += p * p * deviation[g] / (count[g] - 1) / count[g];
+        }
+    } else {
+        for (int g = 0; g < G; g++) m += groupMean[g];
+        m /= G;
+        for (int g = 0; g < G; g++) variance += (groupMean[g] - m) * (groupMean[g] - m);
+        variance /= (double)(G - 1) * G;
+    }
+    *mean = m;
+    *error = sqrt(variance);
+}
+
+// The sampled surges cover the whole distribution up to GevQuantile(maxSampleUniform), while
+// the quadrature of ExpectedAnnualDamage stops at the 0.0001..0.9999 quantiles; this is the range
+// to integrate over when comparing the two
+EadRange SampledSurgeRange(const SurgeGenerator& gev) {
+    EadRange r = {gev, GevQuantile(&gev, 1e-12), GevQuantile(&gev, maxSampleUniform)};
+    return r;
+}
+
+// expected annual damage and threshold event probability of one strategy from a sample
+DamageEstimate EstimateDamage(const double * cityChar, const SurgeSample& sample) {
+    size_t n = sample.surge.size();
+    vector<double> damage(n), over(n);
+    for (size_t i = 0; i < n; i++) {
+        double h = sample.surge[i];
+        double pFail = DikeFailureProbability(SurgeAtDike(cityChar, h), cityChar[dh]);
+        double intact[dvLength], failed[dvLength];
+        CalculateDamage(cityChar, h, 0, intact);
+        CalculateDamage(cityChar, h, 1, failed);
+        damage[i] = sample.weight[i] * (pFail * failed[dvt] + (1 - pFail) * intact[dvt]);
+        over[i] = sample.weight[i] * (pFail * failed[dvTE] + (1 - pFail) * intact[dvTE]);
+    }
+    DamageEstimate estimate;
+    SampleMean(damage, sample, &estimate.damage, &estimate.damageError);
+    SampleMean(over, sample, &estimate.thresholdProbability, &estimate.thresholdError);
+    estimate.events = n;
+    return estimate;
+}
+
+
+// ========================================
+// COLUMN FILES
+// ========================================
+
+// Binary columnar output for results too large for the text dumps. A column file is
+//   header    ColumnFileHeader (magic "ICOWCOL1", version, column count, row count)
+//   directory one ColumnEntry per column (name, type, byte offset of its first value)
+//   data      each column's numRows values back to back, starting on a 64-byte boundary
+// All fields are little-endian, and the data starts on a page boundary, so a reader can
+// mmap the file and use every column in place. Rows can be written in any order and from
+// several threads, since each write goes to a fixed offset.
+const char columnFileMagic[8] = {'I', 'C', 'O', 'W', 'C', 'O', 'L', '1'};
+const uint32_t columnFileVersion = 1;
+const uint32_t columnFloat64 = 1;
+const uint32_t columnInt32 = 2;
+const uint32_t columnFloat32 = 3;
+const uint32_t columnInt64 = 4;
+const int columnNameLength = 24;
+const uint64_t columnDataAlignment = 4096;
+
+struct ColumnFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t numColumns;
+    uint64_t numRows;
+};
+
+struct ColumnEntry {
+    char name[columnNameLength];   // NUL-padded
+    uint32_t type;                 // columnFloat64, columnInt32, columnFloat32 or columnInt64
+    uint32_t width;                // bytes per value
+    uint64_t offset;               // from the start of the file
+};
+
+struct ColumnSpec {
+    const char * name;
+    uint32_t type;
+};
+
+struct ColumnFile {
+    int fd;
+    uint64_t numRows;
+    vector<ColumnEntry> columns;
+};
+
+// names of the cityChar entries and of the damage vector, in index order
+const char * const cityCharNames[numCityChar] = {
+    "caseNum", "wh", "rh", "rp", "dbh", "dh", "vz1", "vz2", "vz3", "vz4", "tz1", "tz2", "tz3", "tz4",
+    "fw", "tcvi", "ilfw", "tcvaw", "vifod", "vbd", "fcv", "dc", "wc", "rc", "tic", "tc", "dtr"};
+const char * const damageVectorNames[dvLength] = {"dvt", "dvz1", "dvz2", "dvz3", "dvz4", "dvFE", "dvBE", "dvTE"};
+
+inline bool HostIsLittleEndian() {
+    const uint16_t probe = 1;
+    unsigned char first;
+    memcpy(&first, &probe, 1);
+    return first == 1;
+}
+
+// Create path sized for numRows rows of the given columns; values not written read as 0
+bool CreateColumnFile(const char * path, const ColumnSpec * specs, int numColumns, uint64_t numRows, ColumnFile * file) {
+    if (!HostIsLittleEndian()) {
+        cerr << "Column files are little-endian; this host is not\n";
+        return false;
+    }
+    file->numRows = numRows;
+    file->columns.assign(numColumns, ColumnEntry());
+    uint64_t offset = sizeof(ColumnFileHeader) + numColumns * sizeof(ColumnEntry);
+    offset = (offset + columnDataAlignment - 1) / columnDataAlignment * columnDataAlignment;
+    for (int k = 0; k < numColumns; k++) {
+        ColumnEntry& e = file->columns[k];
+        memset(&e, 0, sizeof(e));
+        strncpy(e.name, specs[k].name, columnNameLength - 1);
+        e.type = specs[k].type;
+        e.width = (e.type == columnFloat64 || e.type == columnInt64) ? 8 : 4;
+        e.offset = offset;
+        offset += (numRows * e.width + 63) / 64 * 64;
+    }
+    file->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (file->fd < 0) {
+        cerr << "Cannot create column file " << path << "\n";
+        return false;
+    }
+    ColumnFileHeader header;
+    memcpy(header.magic, columnFileMagic, sizeof(header.magic));
+    header.version = columnFileVersion;
+    header.numColumns = numColumns;
+    header.numRows = numRows;
+    size_t directoryBytes = numColumns * sizeof(ColumnEntry);
+    if (ftruncate(file->fd, (off_t)offset) != 0 ||
+        pwrite(file->fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+        pwrite(file->fd, file->columns.data(), directoryBytes, sizeof(header)) != (ssize_t)directoryBytes) {
+        cerr << "Cannot write column file " << path << "\n";
+        close(file->fd);
+        file->fd = -1;
+        return false;
+    }
+    return true;
+}
+
+// write n values of one column starting at firstRow; safe to call from several threads
+bool WriteColumn(const ColumnFile * file, int column, uint64_t firstRow, uint64_t n, const void * values) {
+    const ColumnEntry& e = file->columns[column];
+    if (firstRow + n > file->numRows) return false;
+    const char * p = (const char *)values;
+    size_t bytes = n * e.width;
+    off_t at = (off_t)(e.offset + firstRow * e.width);
+    while (bytes > 0) {
+        ssize_t written = pwrite(file->fd, p, bytes, at);
+        if (written <= 0) return false;
+        p += written;
+        bytes -= written;
+        at += written;
+    }
+    return true;
+}
+
+bool CloseColumnFile(ColumnFile * file) {
+    bool ok = (file->fd >= 0) && (close(file->fd) == 0);
+    file->fd = -1;
+    return ok;
+}
+
+// Open a column file that CreateColumnFile made, for writing more rows into it without
+// truncating it; the columns and the row count must match
+bool ReopenColumnFile(const char * path, const ColumnSpec * specs, int numColumns, uint64_t numRows, ColumnFile * file) {
+    file->fd = open(path, O_RDWR);
+    if (file->fd < 0) {
+        cerr << "Cannot open column file " << path << "\n";
+        return false;
+    }
+    ColumnFileHeader header;
+    file->numRows = numRows;
+    file->columns.assign(numColumns, ColumnEntry());
+    size_t directoryBytes = numColumns * sizeof(ColumnEntry);
+    bool ok = pread(file->fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+              memcmp(header.magic, columnFileMagic, sizeof(header.magic)) == 0 && header.version == columnFileVersion &&
+              header.numColumns == (uint32_t)numColumns && header.numRows == numRows &&
+              pread(file->fd, file->columns.data(), directoryBytes, sizeof(header)) == (ssize_t)directoryBytes;
+    for (int k = 0; ok && k < numColumns; k++)
+        ok = strncmp(file->columns[k].name, specs[k].name, columnNameLength) == 0 && file->columns[k].type == specs[k].type;
+    if (!ok) {
+        cerr << "Column file " << path << " does not have the expected columns\n";
+        close(file->fd);
+        file->fd = -1;
+    }
+    return ok;
+}
+
+// A column file mapped read-only
+struct ColumnFileView {
+    const char * base;
+    size_t bytes;
+    uint64_t numRows;
+    const ColumnEntry * columns;
+    uint32_t numColumns;
+};
+
+bool OpenColumnFile(const char * path, ColumnFileView * view) {
+    view->base = NULL;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    bool ok = (fstat(fd, &st) == 0) && ((size_t)st.st_size >= sizeof(ColumnFileHeader));
+    void * base = ok ? mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (base == MAP_FAILED) return false;
+    ColumnFileHeader header;
+    memcpy(&header, base, sizeof(header));
+    size_t directoryEnd = sizeof(header) + (size_t)header.numColumns * sizeof(ColumnEntry);
+    if (memcmp(header.magic, columnFileMagic, sizeof(header.magic)) != 0 || header.version != columnFileVersion ||
+        directoryEnd > (size_t)st.st_size) {
+        munmap(base, st.st_size);
+        return false;
+    }
+    view->base = (const char *)base;
+    view->bytes = st.st_size;
+    view->numRows = header.numRows;
+    view->columns = (const ColumnEntry *)(view->base + sizeof(header));
+    view->numColumns = header.numColumns;
+    for (uint32_t k = 0; k < view->numColumns; k++) {
+        if (view->columns[k].offset + view->numRows * view->columns[k].width > view->bytes) {
+            munmap(base, st.st_size);
+            view->base = NULL;
+            return false;
+        }
+    }
+    return true;
+}
+
+// the values of the named column, or NULL if there is none
+const void * FindColumn(const ColumnFileView * view, const char * name, uint32_t type) {
+    for (uint32_t k = 0; k < view->numColumns; k++) {
+        const ColumnEntry& e = view->columns[k];
+        if (e.type == type && strncmp(e.name, name, columnNameLength) == 0) return view->base + e.offset;
+    }
+    return NULL;
+}
+
+void CloseColumnFileView(ColumnFileView * view) {
+    if (view->base) munmap((void *)view->base, view->bytes);
+    view->base = NULL;
+}
+
+
+// ========================================
+// CHECKPOINT FILES
+// ========================================
+
+// A checkpoint is a column file holding a run's state as named columns of different
+// lengths; rows past a column's length read as 0. It is written to path.tmp, synced and
+// renamed over path, so a preempted write leaves the previous checkpoint intact.
+struct CheckpointColumn {
+    const char * name;   // a string literal
+    uint32_t type;
+    vector<char> bytes;
+};
+
+struct CheckpointData {
+    vector<CheckpointColumn> columns;
+};
+
+template <typename T>
+void AddCheckpointColumn(CheckpointData * data, const char * name, uint32_t type, const vector<T>& values) {
+    CheckpointColumn c = {name, type, vector<char>(values.size() * sizeof(T))};
+    if (!values.empty()) memcpy(c.bytes.data(), values.data(), c.bytes.size());
+    data->columns.push_back(std::move(c));
+}
+
+// the first count values of a checkpoint column; false when it is missing or too short
+template <typename T>
+bool ReadCheckpointColumn(const ColumnFileView * view, const char * name, uint32_t type, size_t count, vector<T> * values) {
+    const T * p = (const T *)FindColumn(view, name, type);
+    if (!p || count > view->numRows) return false;
+    values->assign(p, p + count);
+    return true;
+}
+
+bool WriteCheckpointFile(const char * path, const CheckpointData& data) {
+    vector<ColumnSpec> specs;
+    uint64_t numRows = 1;
+    for (const auto& c : data.columns) {
+        specs.push_back({c.name, c.type});
+        numRows = std::max<uint64_t>(numRows, c.bytes.size() / ((c.type == columnFloat64 || c.type == columnInt64) ? 8 : 4));
+    }
+    string tmp = string(path) + ".tmp";
+    ColumnFile file;
+    bool ok = CreateColumnFile(tmp.c_str(), specs.data(), specs.size(), numRows, &file);
+    for (size_t k = 0; ok && k < data.columns.size(); k++) {
+        const CheckpointColumn& c = data.columns[k];
+        ok = WriteColumn(&file, k, 0, c.bytes.size() / file.columns[k].width, c.bytes.data());
+    }
+    ok = ok && fsync(file.fd) == 0;
+    if (file.fd >= 0) ok = CloseColumnFile(&file) && ok;
+    ok = ok && rename(tmp.c_str(), path) == 0;
+    if (!ok) cerr << "Writing checkpoint " << path << " failed\n";
+    return ok;
+}
+
+// Writes checkpoints on a thread of its own, so the computation never waits for the disk. A
+// job fills in its CheckpointData on that thread (returning false if it cannot) and replaces
+// any job not yet started, since only the newest state matters; stopping runs the last job
+// before returning.
+struct CheckpointWriter {
+    string path;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::function<bool(CheckpointData *)> job;
+    bool stopping = false;
+    bool ok = true;
+    int64_t written = 0;
+};
+
+void StartCheckpointWriter(CheckpointWriter * writer, const char * path) {
+    writer->path = path;
+    writer->thread = std::thread([writer]() {
+        std::unique_lock<std::mutex> lock(writer->mutex);
+        while (true) {
+            writer->wake.wait(lock, [writer]() { return writer->job || writer->stopping; });
+            if (!writer->job) break;
+            std::function<bool(CheckpointData *)> job;
+            job.swap(writer->job);
+            lock.unlock();
+            CheckpointData data;
+            bool ok = job(&data) && WriteCheckpointFile(writer->path.c_str(), data);
+            lock.lock();
+            writer->ok = writer->ok && ok;
+            writer->written++;
+        }
+    });
+}
+
+void SubmitCheckpoint(CheckpointWriter * writer, std::function<bool(CheckpointData *)> job) {
+    {
+        std::lock_guard<std::mutex> lock(writer->mutex);
+        writer->job = std::move(job);
+    }
+    writer->wake.notify_one();
+}
+
+// run the pending job, stop the thread and return whether every write succeeded
+bool StopCheckpointWriter(CheckpointWriter * writer) {
+    {
+        std::lock_guard<std::mutex> lock(writer->mutex);
+        writer->stopping = true;
+    }
+    writer->wake.notify_one();
+    writer->thread.join();
+    return writer->ok;
+}
+
+// the meta column of every checkpoint starts with its kind and the surge block it was run against
+const int64_t sweepCheckpointKind = 1;
+const int64_t optimiserCheckpointKind = 2;
+const int metaKind = 0;
+const int metaCandidates = 1;    // rows of the candidate columns
+const int metaSurgeSeed = 2;
+const int metaFirstSequence = 3;
+const int metaNumSequences = 4;  // -1 without a surge block
+
+inline int64_t CheckpointClock() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Map the checkpoint at path and read its first numMeta meta values, checking its kind
+bool OpenCheckpointFile(const char * path, int64_t kind, int numMeta, ColumnFileView * view, vector<int64_t> * meta) {
+    if (!OpenColumnFile(path, view)) {
+        cerr << "Cannot read checkpoint " << path << "\n";
+        return false;
+    }
+    if (!ReadCheckpointColumn(view, "meta", columnInt64, numMeta, meta) || (*meta)[metaKind] != kind) {
+        cerr << path << " is not a checkpoint of this kind of run\n";
+        CloseColumnFileView(view);
+        return false;
+    }
+    return true;
+}
+
+
+// ========================================
+// SURGE FILES
+// ========================================
+
+// Surge ensembles on disk, read through mmap without a copy. A surge file is
+//   header SurgeFileHeader (magic "ICOWSRG1", version, value type, sequences, years, data offset)
+//   data   numSequences*numYears values, sequence-major (the years of one sequence together)
+// Values are little-endian float64 or float32 and the data starts on a page boundary.
+// Float64 blocks point straight into the mapping; float32 blocks are widened to double
+// into one reusable buffer of maxSurgeBlock sequences.
+const char surgeFileMagic[8] = {'I', 'C', 'O', 'W', 'S', 'R', 'G', '1'};
+const uint32_t surgeFileVersion = 1;
+
+struct SurgeFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t valueType;      // columnFloat64 or columnFloat32
+    uint32_t numSequences;
+    uint32_t numYears;
+    uint64_t dataOffset;
+};
+
+struct SurgeFile {
+    const char * base;       // the whole mapping
+    size_t bytes;
+    uint32_t valueType;
+    int numSequences, numYears;
+    const char * data;
+    size_t valueBytes;
+    vector<double> widened;  // float32 only: the current block as double
+};
+
+// Write nS sequences of nY sequence-major surges, stored as valueType
+bool WriteSurgeFile(const char * path, const double * surge, int nS, int nY, uint32_t valueType) {
+    if (!HostIsLittleEndian() || (valueType != columnFloat64 && valueType != columnFloat32)) return false;
+    SurgeFileHeader header;
+    memcpy(header.magic, surgeFileMagic, sizeof(header.magic));
+    header.version = surgeFileVersion;
+    header.valueType = valueType;
+    header.numSequences = nS;
+    header.numYears = nY;
+    header.dataOffset = columnDataAlignment;
+    ofstream out(path, std::ios::binary);
+    out.write((const char *)&header, sizeof(header));
+    vector<char> padding(header.dataOffset - sizeof(header), 0);
+    out.write(padding.data(), padding.size());
+    if (valueType == columnFloat64) {
+        out.write((const char *)surge, (std::streamsize)nS * nY * sizeof(double));
+    } else {
+        vector<float> narrow(nY);
+        for (int s = 0; s < nS; s++) {
+            for (int y = 0; y < nY; y++) narrow[y] = (float)surge[(size_t)s * nY + y];
+            out.write((const char *)narrow.data(), nY * sizeof(float));
+        }
+    }
+    out.close();
+    return !out.fail();
+}
+
+// Map path read-only. sequential asks the kernel to read ahead and drop pages behind the reader.
+bool OpenSurgeFile(const char * path, bool sequential, SurgeFile * file) {
+    file->base = NULL;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    bool ok = (fstat(fd, &st) == 0) && ((size_t)st.st_size >= sizeof(SurgeFileHeader));
+    void * base = ok ? mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (base == MAP_FAILED) return false;
+    SurgeFileHeader header;
+    memcpy(&header, base, sizeof(header));
+    size_t valueBytes = (header.valueType == columnFloat32) ? sizeof(float) : sizeof(double);
+    if (memcmp(header.magic, surgeFileMagic, sizeof(header.magic)) != 0 || header.version != surgeFileVersion ||
+        (header.valueType != columnFloat64 && header.valueType != columnFloat32) ||
+        header.dataOffset % columnDataAlignment != 0 ||
+        header.dataOffset + (uint64_t)header.numSequences * header.numYears * valueBytes > (uint64_t)st.st_size) {
+        munmap(base, st.st_size);
+        cerr << "Not a valid surge file: " << path << "\n";
+        return false;
+    }
+    if (sequential) madvise(base, st.st_size, MADV_SEQUENTIAL);
+    file->base = (const char *)base;
+    file->bytes = st.st_size;
+    file->valueType = header.valueType;
+    file->numSequences = header.numSequences;
+    file->numYears = header.numYears;
+    file->data = file->base + header.dataOffset;
+    file->valueBytes = valueBytes;
+    if (file->valueType == columnFloat32) file->widened.resize((size_t)maxSurgeBlock * file->numYears);
+    return true;
+}
+
+int SurgeFileBlocks(const SurgeFile * file) {
+    return (file->numSequences + maxSurgeBlock - 1) / maxSurgeBlock;
+}
+
+// madvise over the pages holding sequences [s0, s1)
+void AdviseSurgeSequences(const SurgeFile * file, int s0, int s1, int advice) {
+    const size_t page = columnDataAlignment;
+    size_t begin = (file->data - file->base) + (size_t)s0 * file->numYears * file->valueBytes;
+    size_t end = (file->data - file->base) + (size_t)s1 * file->numYears * file->valueBytes;
+    begin = begin / page * page;
+    if (end > begin) madvise((void *)(file->base + begin), end - begin, advice);
+}
+
+// View block k (maxSurgeBlock sequences, fewer in the last block) as a sequence-major SurgeBlock
+// without a breach mask. The view of a float32 file lasts until the next call; the following
+// block is prefetched.
+bool SurgeFileBlock(SurgeFile * file, int k, SurgeBlock * block) {
+    if (k < 0 || k >= SurgeFileBlocks(file)) return false;
+    int s0 = k * maxSurgeBlock;
+    int nS = std::min(maxSurgeBlock, file->numSequences - s0);
+    size_t n = (size_t)nS * file->numYears;
+    const char * values = file->data + (size_t)s0 * file->numYears * file->valueBytes;
+    if (k + 1 < SurgeFileBlocks(file))
+        AdviseSurgeSequences(file, s0 + nS, std::min(file->numSequences, s0 + nS + maxSurgeBlock), MADV_WILLNEED);
+    if (file->valueType == columnFloat64) {
+        block->surge = (const double *)values;
+    } else {
+        const float * narrow = (const float *)values;
+        double * wide = file->widened.data();
+        #pragma omp simd
+        for (size_t i = 0; i < n; i++) wide[i] = narrow[i];
+        block->surge = wide;
+    }
+    block->breachMask = NULL;
+    block->numSequences = nS;
+    block->numYears = file->numYears;
+    block->layout = sequenceMajor;
+    return true;
+}
+
+// SimulateSurgeBlock over every block of the file; out holds one value per sequence of the file
+bool SimulateSurgeFile(const double * cityChar, SurgeFile * file, SequenceDamage out) {
+    for (int k = 0; k < SurgeFileBlocks(file); k++) {
+        SurgeBlock block;
+        if (!SurgeFileBlock(file, k, &block)) return false;
+        size_t s0 = (size_t)k * maxSurgeBlock;
+        SequenceDamage part = {out.damage + s0, out.floodEvents + s0, out.breachEvents + s0, out.thresholdEvents + s0};
+        SimulateSurgeBlock(cityChar, &block, part);
+    }
+    return true;
+}
+
+void CloseSurgeFile(SurgeFile * file) {
+    if (file->base) munmap((void *)file->base, file->bytes);
+    file->base = NULL;
+    file->widened.clear();
+    file->widened.shrink_to_fit();
+}
+
+
+// ========================================
+// EVALUATION ARENAS
+// ========================================
+
+// A fixed block of scratch memory for one thread. Allocations are bumped from the front and
+// aligned for the widest vectors; a reset moves the front back to a mark, so the scratch of
+// one strategy is released in O(1) and the next strategy reuses the same memory.
+const size_t arenaAlignment = 64;
+
+struct EvaluationArena {
+    char * base;
+    size_t capacity;
+    size_t used;
+    size_t peak;        // largest used since InitEvaluationArena
+};
+
+bool InitEvaluationArena(EvaluationArena * arena, size_t capacity) {
+    void * memory = NULL;
+    arena->capacity = (capacity + arenaAlignment - 1) / arenaAlignment * arenaAlignment;
+    if (posix_memalign(&memory, arenaAlignment, std::max(arena->capacity, arenaAlignment)) != 0) memory = NULL;
+    arena->base = (char *)memory;
+    arena->used = 0;
+    arena->peak = 0;
+    return arena->base != NULL;
+}
+
+// count objects of T from the arena, or NULL when it is full
+template <class T>
+T * ArenaAlloc(EvaluationArena * arena, size_t count) {
+    size_t begin = (arena->used + arenaAlignment - 1) / arenaAlignment * arenaAlignment;
+    size_t bytes = count * sizeof(T);
+    if (begin > arena->capacity || bytes > arena->capacity - begin) return NULL;
+    arena->used = begin + bytes;
+    arena->peak = std::max(arena->peak, arena->used);
+    return (T *)(arena->base + begin);
+}
+
+// release everything allocated after mark (an earlier value of arena->used)
+inline void ResetEvaluationArena(EvaluationArena * arena, size_t mark = 0) {
+    arena->used = mark;
+}
+
+void FreeEvaluationArena(EvaluationArena * arena) {
+    free(arena->base);
+    arena->base = NULL;
+}
+
+// worst-case bytes of scratch for count objects of T, alignment padding included
+template <class T>
+size_t ArenaBytes(size_t count) {
+    return (count * sizeof(T) + arenaAlignment - 1) / arenaAlignment * arenaAlignment;
+}
+
+// scratch for scoring one strategy against a surge block
+struct SurgeEvaluation {
+    double * cityChar;        // numCityChar entries
+    uint64_t * breachMask;    // SurgeRowWords(block) words per row of the block
+    SequenceDamage totals;    // one value per sequence
+};
+
+size_t SequenceDamageBytes(int numSequences) {
+    return ArenaBytes<double>(numSequences) + 3 * ArenaBytes<int>(numSequences);
+}
+
+size_t SurgeEvaluationBytes(const SurgeBlock * block) {
+    int numRows = (block->layout == yearMajor) ? block->numYears : block->numSequences;
+    return ArenaBytes<double>(numCityChar) + ArenaBytes<uint64_t>((size_t)numRows * SurgeRowWords(block)) +
+           SequenceDamageBytes(block->numSequences);
+}
+
+// per-sequence totals for numSequences sequences from the arena; false when they do not fit
+bool ArenaSequenceDamage(EvaluationArena * arena, int numSequences, SequenceDamage * totals) {
+    totals->damage = ArenaAlloc<double>(arena, numSequences);
+    totals->floodEvents = ArenaAlloc<int>(arena, numSequences);
+    totals->breachEvents = ArenaAlloc<int>(arena, numSequences);
+    totals->thresholdEvents = ArenaAlloc<int>(arena, numSequences);
+    return totals->damage && totals->floodEvents && totals->breachEvents && totals->thresholdEvents;
+}
+
+// carve a SurgeEvaluation for block out of the arena; false when it does not fit
+bool ArenaSurgeEvaluation(EvaluationArena * arena, const SurgeBlock * block, SurgeEvaluation * eval) {
+    int numRows = (block->layout == yearMajor) ? block->numYears : block->numSequences;
+    eval->cityChar = ArenaAlloc<double>(arena, numCityChar);
+    eval->breachMask = ArenaAlloc<uint64_t>(arena, (size_t)numRows * SurgeRowWords(block));
+    return ArenaSequenceDamage(arena, block->numSequences, &eval->totals) && eval->cityChar && eval->breachMask;
+}
+
+// Score eval->cityChar against the surges of block with dike failures drawn for this strategy
+// (SampleDikeFailures into eval->breachMask; block->breachMask is ignored). Returns the mean
+// damage per sequence and sets the breach frequency per simulated year.
+double ScoreSampledBreaches(const SurgeGenerator * gen, uint64_t firstSequence, const SurgeBlock * block,
+                            SurgeEvaluation * eval, double * breachFrequency) {
+    SurgeBlock sampled = *block;
+    SampleDikeFailures(eval->cityChar, gen, firstSequence, block, eval->breachMask);
+    sampled.breachMask = eval->breachMask;
+    SimulateSurgeBlock(eval->cityChar, &sampled, eval->totals);
+    double damage = 0, breaches = 0;
+    for (int s = 0; s < block->numSequences; s++) {
+        damage += eval->totals.damage[s];
+        breaches += eval->totals.breachEvents[s];
+    }
+    *breachFrequency = breaches / ((double)block->numSequences * block->numYears);
+    return damage / block->numSequences;
+}
+
+
+// ========================================
+// INSTRUMENTATION
+// ========================================
+
+// Sweep counters, compiled in with -DICOW_INSTRUMENT. Without it the recording calls below are
+// empty and the optimizer drops them together with their clock reads.
+#ifdef ICOW_INSTRUMENT
+const bool instrumented = true;
+#else
+const bool instrumented = false;
+#endif
+
+// sweep stages timed per chunk: the batch characterization, the surge damage of every strategy
+// and the best/Pareto reduction
+const int stageCharacterize = 0;
+const int stageDamage = 1;
+const int stageReduce = 2;
+const int numSweepStages = 3;
+const char * const sweepStageNames[numSweepStages] = {"characterize", "damage", "reduce"};
+
+// bucket b counts chunk latencies in [2^b, 2^(b+1)) ns
+const int latencyBuckets = 40;
+
+struct SweepStats {
+    int64_t caseHits[10];                                 // strategies per case 1..9
+    int64_t latency[numSweepStages][latencyBuckets];
+    int64_t stageNanoseconds[numSweepStages];
+};
+
+void ClearSweepStats(SweepStats * stats) {
+    memset(stats, 0, sizeof(SweepStats));
+}
+
+void MergeSweepStats(SweepStats * into, const SweepStats * from) {
+    for (int c = 0; c < 10; c++) into->caseHits[c] += from->caseHits[c];
+    for (int k = 0; k < numSweepStages; k++) {
+        for (int b = 0; b < latencyBuckets; b++) into->latency[k][b] += from->latency[k][b];
+        into->stageNanoseconds[k] += from->stageNanoseconds[k];
+    }
+}
+
+inline int64_t StageClock() {
+    if (!instrumented) return 0;
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// file the time since start (a StageClock value) under stage
+inline void RecordStage(SweepStats * stats, int stage, int64_t start) {
+    if (!instrumented) return;
+    int64_t ns = std::max<int64_t>(1, StageClock() - start);
+    int b = 0;
+    while (b + 1 < latencyBuckets && (ns >> (b + 1)) != 0) b++;
+    stats->latency[stage][b]++;
+    stats->stageNanoseconds[stage] += ns;
+}
+
+inline void CountCases(SweepStats * stats, const int * caseCol, int n) {
+    if (!instrumented) return;
+    for (int i = 0; i < n; i++) stats->caseHits[caseCol[i]]++;
+}
+
+// upper edge in ns of the bucket holding quantile q of a latency histogram
+double LatencyQuantile(const int64_t * histogram, double q) {
+    int64_t total = 0;
+    for (int b = 0; b < latencyBuckets; b++) total += histogram[b];
+    int64_t seen = 0;
+    for (int b = 0; b < latencyBuckets; b++) {
+        seen += histogram[b];
+        if (seen > 0 && seen >= q * total) return ldexp(1.0, b + 1);
+    }
+    return 0;
+}
+
+void PrintSweepStats(ostream& out, const SweepStats * stats) {
+    int64_t strategies = 0;
+    for (int c = 1; c <= 9; c++) strategies += stats->caseHits[c];
+    out << std::setprecision(4);
+    out << "# sweep instrumentation: " << strategies << " strategies\n";
+    out << "case  strategies  share\n";
+    for (int c = 1; c <= 9; c++)
+        out << c << "  " << stats->caseHits[c] << "  " << (strategies ? (double)stats->caseHits[c] / strategies : 0) << "\n";
+    out << "stage  chunks  total_s  p50_us  p99_us  max_us\n";
+    for (int k = 0; k < numSweepStages; k++) {
+        int64_t chunks = 0;
+        for (int b = 0; b < latencyBuckets; b++) chunks += stats->latency[k][b];
+        out << sweepStageNames[k] << "  " << chunks << "  " << stats->stageNanoseconds[k] * 1e-9 << "  "
+            << LatencyQuantile(stats->latency[k], 0.5) * 1e-3 << "  " << LatencyQuantile(stats->latency[k], 0.99) * 1e-3
+            << "  " << LatencyQuantile(stats->latency[k], 1.0) * 1e-3 << "\n";
+    }
+}
+
+// totals over every sweep of the process, printed to stderr at exit
+SweepStats processSweepStats;
+std::mutex processSweepStatsMutex;
+
+void PrintProcessSweepStats() {
+    PrintSweepStats(cerr, &processSweepStats);
+}
+
+// add one sweep's merged counters to the process totals (once per sweep, not per strategy)
+void AddProcessSweepStats(const SweepStats * stats) {
+    if (!instrumented) return;
+    std::lock_guard<std::mutex> lock(processSweepStatsMutex);
+    static bool registered = false;
+    if (!registered) {
+        std::atexit(PrintProcessSweepStats);
+        registered = true;
+    }
+    MergeSweepStats(&processSweepStats, stats);
+}
+
+
+// ========================================
+// PARALLEL GRID SWEEP
+// ========================================
+
+// one lever of the sweep grid: count values min, min+step, ...
+struct LeverAxis {
+    double min;
+    double step;
+    int count;
+    double Value(int k) const { return min + k * step; }
+};
+
+// strategy grid, flattened with B varying fastest: index = (((iW*nR + iR)*nP + iP)*nD + iD)*nB + iB
+struct SweepGrid {
+    LeverAxis W, R, P, D, B;
+    int64_t Size() const { return (int64_t)W.count * R.count * P.count * D.count * B.count; }
+};
+
+// strategies per unit of work handed out by the sweep scheduler
+const int sweepChunk = 256;
+
+struct SweepCandidate {
+    int64_t index;      // grid index
+    double W, R, P, D, B;
+    double tic;         // total investment cost
+    double damage;      // mean damage per surge sequence, 0 without a surge block
+    double breachFrequency;   // dike breaches (dvBE) per simulated year, 0 without a surge block
+    double totalCost;   // cityChar[tc] + damage
+    int sequences;      // surge sequences scored: all of the block, fewer if adaptive stopping ended early
+};
+
+// is_feasible of the Julia model: the withdrawal must leave a city (W = CEC divides by zero in
+// the withdrawal cost) and the dike top must not be above the city elevation. The kernels
+// return costs for any levers, but past W + B + D = CEC the zone heights go negative and the
+// costs mean nothing, so the sweep scores infeasible strategies as infinite like the simulation.
+inline bool StrategyFeasible(double W, double B, double D) {
+    return W < CEC && W + B + D <= CEC;
+}
+
+struct SweepResult {
+    SweepCandidate best;               // lowest totalCost of the feasible strategies, lowest index on
+                                       // ties; index -1 and totalCost +inf when none is feasible
+    vector<SweepCandidate> pareto;     // ParetoArchive members, sorted by tic then index; empty with prune
+    bool paretoValid;                  // false with prune: pruned strategies could have been on the front
+    int64_t evaluated;
+    int numThreads;
+    bool rowsWritten;                  // every row reached the column file, if one was given
+    int64_t pruned;                    // strategies not scored against the surges (prune only)
+    int64_t infeasible;                // strategies failing StrategyFeasible, never scored
+    int64_t sequencesScored;           // surge sequences scored, summed over the strategies
+    int64_t deduplicated;              // strategies that took the score of an equivalent city
+    size_t scratchBytes;               // peak arena bytes, summed over the threads
+    SweepStats stats;                  // merged worker counters, all zero without ICOW_INSTRUMENT
+    bool checkpointed;                 // every checkpoint was written, if a checkpoint was given
+};
+
+// the per-strategy columns a sweep can write, one row per grid index
+const ColumnSpec sweepColumns[] = {
+    {"W", columnFloat64}, {"R", columnFloat64}, {"P", columnFloat64}, {"D", columnFloat64}, {"B", columnFloat64},
+    {"caseNum", columnInt32},
+    {"wc", columnFloat64}, {"rc", columnFloat64}, {"dc", columnFloat64}, {"tic", columnFloat64}, {"tc", columnFloat64},
+    {"vz1", columnFloat64}, {"vz2", columnFloat64}, {"vz3", columnFloat64}, {"vz4", columnFloat64},
+    {"tz1", columnFloat64}, {"tz2", columnFloat64}, {"tz3", columnFloat64}, {"tz4", columnFloat64},
+    {"damage", columnFloat64}, {"breachFrequency", columnFloat64}, {"sequences", columnInt32}};
+const int numSweepColumns = sizeof(sweepColumns) / sizeof(sweepColumns[0]);
+
+// Box sizes for epsilon-dominance on (tic, damage, breachFrequency). A positive size splits that
+// objective into boxes of that width and keeps one strategy per non-dominated box, which caps
+// the archive at the number of such boxes; 0 compares the objective exactly.
+struct ParetoEpsilon {
+    double tic = 0;
+    double damage = 0;
+    double breachFrequency = 0;
+};
+
+// Streaming non-dominated set over (tic, damage, breachFrequency), minimised. Memory is the
+// front itself. Strategies are compared by their boxes: a dominated box is dropped and a shared
+// box keeps the strategy nearest its lower corner, then the lower index. With every epsilon 0 a
+// box is the point itself, so this is plain Pareto dominance with ties broken by index. Either
+// way the result does not depend on insertion order, so any thread count gives the same front.
+struct ParetoArchive {
+    ParetoEpsilon epsilon;
+    vector<SweepCandidate> members;
+};
+
+const int numSweepObjectives = 3;
+
+inline void ParetoBox(const ParetoEpsilon& eps, const SweepCandidate& c, double box[numSweepObjectives], double& corner) {
+    const double f[numSweepObjectives] = {c.tic, c.damage, c.breachFrequency};
+    const double e[numSweepObjectives] = {eps.tic, eps.damage, eps.breachFrequency};
+    corner = 0;
+    for (int k = 0; k < numSweepObjectives; k++) {
+        box[k] = (e[k] > 0) ? floor(f[k] / e[k]) : f[k];
+        double offset = (e[k] > 0) ? f[k] / e[k] - box[k] : 0;
+        corner += offset * offset;
+    }
+}
+
+// add c to the archive, dropping the members it dominates. Strategies with an undefined
+// objective (W=CEC leaves no city, so tic is NaN) are not comparable and are not archived.
+void ParetoInsert(ParetoArchive& archive, const SweepCandidate& c) {
+    double box[numSweepObjectives], corner;
+    ParetoBox(archive.epsilon, c, box, corner);
+    if (box[0] != box[0] || box[1] != box[1] || box[2] != box[2]) return;
+    vector<SweepCandidate>& members = archive.members;
+    size_t kept = 0;
+    for (size_t i = 0; i < members.size(); i++) {
+        double other[numSweepObjectives], otherCorner;
+        ParetoBox(archive.epsilon, members[i], other, otherCorner);
+        bool noWorse = true, noBetter = true;
+        for (int k = 0; k < numSweepObjectives; k++) {
+            noWorse = noWorse && box[k] <= other[k];
+            noBetter = noBetter && box[k] >= other[k];
+        }
+        bool sameBox = noWorse && noBetter;
+        bool replaces = sameBox && (corner < otherCorner || (corner == otherCorner && c.index < members[i].index));
+        // a dominated c returns before anything is dropped: a member that c dominates
+        // would be dominated by the member that dominates c
+        if ((noBetter && !sameBox) || (sameBox && !replaces)) return;
+        if (!noWorse) members[kept++] = members[i];
+    }
+    members.resize(kept);
+    members.push_back(c);
+}
+
+void ParetoMerge(ParetoArchive& into, const ParetoArchive& from) {
+    for (const auto& c : from.members) ParetoInsert(into, c);
+}
+
+void SortByInvestment(vector<SweepCandidate>& front) {
+    std::sort(front.begin(), front.end(),
+              [](const SweepCandidate& a, const SweepCandidate& b) { return a.tic < b.tic || (a.tic == b.tic && a.index < b.index); });
+}
+
+inline bool SweepBetter(const SweepCandidate& a, const SweepCandidate& b) {
+    return a.totalCost < b.totalCost || (a.totalCost == b.totalCost && a.index < b.index);
+}
+
+// whether a worker, snapshot or result holds a best strategy: pruned and infeasible strategies
+// never become the best
+template <class Reductions>
+inline bool SweepHasBest(const Reductions& r) {
+    return r.evaluated > r.pruned + r.infeasible;
+}
+
+// Per-thread scheduler and reduction state. range packs the worker's remaining chunks as
+// begin (high 32 bits) and end (low 32 bits); the owner takes chunks from the front and
+// thieves take the upper half from the back, both with a compare-and-swap.
+struct SweepWorker {
+    std::atomic<uint64_t> range;
+    char pad[64 - sizeof(std::atomic<uint64_t>)];  // keep each range on its own cache line
+    SweepCandidate best;
+    ParetoArchive front;
+    int64_t evaluated;
+    int64_t pruned;
+    int64_t infeasible;
+    int64_t sequencesScored;
+    int64_t deduplicated;
+    bool rowsWritten;
+    SweepStats stats;
+    EvaluationArena arena;     // all of the worker's scratch
+    vector<uint32_t> unsaved;  // chunks finished since the worker last saved a snapshot
+    int64_t nextSnapshot;      // CheckpointClock time of the next snapshot
+};
+
+// arena capacity of one sweep worker: the chunk columns plus one strategy's per-sequence totals
+size_t SweepScratchBytes(const SurgeBlock * surges) {
+    return ArenaBytes<double>(8 * sweepChunk) + ArenaBytes<double>(13 * sweepChunk) + 2 * ArenaBytes<int>(sweepChunk) +
+           (surges ? SequenceDamageBytes(surges->numSequences) : 0);
+}
+
+// Adaptive early stopping of the surge scoring. Sequences are scored in sub-blocks while a
+// running mean and variance (Welford) of the per-sequence damage is kept. Scoring stops once the
+// confidence half-width z*sd/sqrt(k) is at most relativeTolerance times the total cost
+// tc + mean, or, with stopWorse, once the lower bound tc + mean - halfWidth is above the
+// incumbent's total cost. At least minSequences are always scored.
+struct AdaptiveStopping {
+    double relativeTolerance = 0.01;
+    double z = 1.96;            // two-sided 95%
+    int subBlock = 256;         // sequences per sub-block, rounded up to whole tiles of surgeTile
+    int minSequences = 256;
+    bool stopWorse = true;
+};
+
+struct AdaptiveScore {
+    double damage;            // mean damage over the scored sequences
+    double breachFrequency;   // dvBE per scored year
+    double halfWidth;         // confidence half-width of damage
+    int sequences;            // sequences scored
+};
+
+// Score cityChar against the first sequences of block until options stop it. seq receives the
+// totals of the scored sequences; incumbent is the total cost to beat (INFINITY for none).
+AdaptiveScore SimulateSurgeBlockAdaptive(const double * cityChar, const SurgeBlock * block, SequenceDamage seq,
+                                         const AdaptiveStopping& options, double incumbent) {
+    int nS = block->numSequences;
+    int step = std::max(1, (options.subBlock + surgeTile - 1) / surgeTile) * surgeTile;
+    int minSequences = std::max(options.minSequences, 2);
+    double mean = 0, m2 = 0, breaches = 0;
+    int k = 0;
+    while (k < nS) {
+        int end = std::min(nS, k + step);
+        SimulateSurgeSequences(cityChar, block, k, end, seq);
+        for (int s = k; s < end; s++) {
+            double delta = seq.damage[s] - mean;
+            mean += delta / (s + 1);
+            m2 += delta * (seq.damage[s] - mean);
+            breaches += seq.breachEvents[s];
+        }
+        k = end;
+        if (k < minSequences || k == nS) continue;
+        double halfWidth = options.z * sqrt(m2 / (k - 1) / k);
+        double totalCost = cityChar[tc] + mean;
+        if (halfWidth <= options.relativeTolerance * fabs(totalCost)) break;
+        if (options.stopWorse && totalCost - halfWidth > incumbent) break;
+    }
+    AdaptiveScore score;
+    score.damage = mean;
+    score.breachFrequency = (k > 0) ? breaches / ((double)k * block->numYears) : 0;
+    score.halfWidth = (k > 1) ? options.z * sqrt(m2 / (k - 1) / k) : 0;
+    score.sequences = k;
+    return score;
+}
+
+// Lowest total cost found by any worker so far, shared by all threads. Damage is never
+// negative, so totalCost = tc + damage >= tc and a strategy whose tc already exceeds the
+// bound cannot become the best; it only needs the cheap cost columns.
+struct SweepBound {
+    std::atomic<double> totalCost;
+};
+
+// lower the shared bound to totalCost unless another worker already went below it
+void LowerSweepBound(SweepBound * bound, double totalCost) {
+    double current = bound->totalCost.load(std::memory_order_relaxed);
+    while (totalCost < current && !bound->totalCost.compare_exchange_weak(current, totalCost, std::memory_order_relaxed)) {}
+}
+
+inline uint64_t SweepRange(uint32_t begin, uint32_t end) { return ((uint64_t)begin << 32) | end; }
+
+// take the next chunk of worker w, or return false when its range is empty
+bool SweepPopChunk(SweepWorker& w, uint32_t& chunk) {
+    uint64_t r = w.range.load();
+    while ((uint32_t)(r >> 32) < (uint32_t)r) {
+        if (w.range.compare_exchange_weak(r, r + ((uint64_t)1 << 32))) {
+            chunk = (uint32_t)(r >> 32);
+            return true;
+        }
+    }
+    return false;
+}
+
+// move the upper half of another worker's chunks into worker self. A range only changes by
+// losing its first chunk or its upper half, and a worker steals only once its range is empty,
+// so an old range value never recurs and the compare-and-swap is safe from ABA.
+bool SweepSteal(SweepWorker * workers, int numWorkers, int self) {
+    for (int k = 1; k < numWorkers; k++) {
+        SweepWorker& victim = workers[(self + k) % numWorkers];
+        uint64_t r = victim.range.load();
+        while (true) {
+            uint32_t begin = (uint32_t)(r >> 32), end = (uint32_t)r;
+            if (begin >= end || end - begin < 2) break;
+            uint32_t mid = begin + (end - begin) / 2;
+            if (victim.range.compare_exchange_weak(r, SweepRange(begin, mid))) {
+                workers[self].range.store(SweepRange(mid, end));
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// ---- deduplication ----
+
+// CharacterizeCity collapses many lever tuples onto one city: R < minHeight gives rh=0 and
+// rp=0.5 whatever P is, and a dike D with B < minHeight and R >= minHeight zeroes dbh and rh.
+// Every other cityChar entry is computed from the effective levers (wh, rh, rp, dbh, dh), so
+// strategies with equal effective levers have bitwise equal damage against a surge block. A
+// city with rh > 0 and dbh > 0 has its levers as effective levers and no alias, so only cities
+// with rh == 0 or dbh == 0 need to be looked up.
+struct CityKey {
+    double levers[5];   // wh, rh, rp, dbh, dh, with -0 as +0
+    bool operator==(const CityKey& other) const { return memcmp(levers, other.levers, sizeof(levers)) == 0; }
+};
+
+struct CityKeyHash {
+    size_t operator()(const CityKey& key) const {
+        uint64_t h = 0x9e3779b97f4a7c15ull;
+        for (double v : key.levers) {
+            uint64_t bits;
+            memcpy(&bits, &v, sizeof(bits));
+            h = (h ^ bits) * 0xff51afd7ed558ccdull;
+            h ^= h >> 33;
+        }
+        return (size_t)h;
+    }
+};
+
+inline bool CityMayAlias(const double * cityChar) {
+    return cityChar[rh] == 0 || cityChar[dbh] == 0;
+}
+
+inline CityKey MakeCityKey(const double * cityChar) {
+    CityKey key = {{cityChar[wh] + 0.0, cityChar[rh] + 0.0, cityChar[rp] + 0.0, cityChar[dbh] + 0.0, cityChar[dh] + 0.0}};
+    return key;
+}
+
+struct CityScore {
+    double damage;
+    double breachFrequency;
+    int sequences;
+};
+
+// Scores of the aliasing cities of one sweep, shared by all threads and split into shards so
+// workers rarely wait on each other. Two workers may both miss and score the same city; they
+// store the same score, so that only costs time.
+const int cityScoreShards = 64;
+
+struct CityScoreCache {
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<CityKey, CityScore, CityKeyHash> scores;
+    };
+    Shard shards[cityScoreShards];
+};
+
+bool FindCityScore(CityScoreCache * cache, const CityKey& key, CityScore * score) {
+    CityScoreCache::Shard& shard = cache->shards[CityKeyHash()(key) % cityScoreShards];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.scores.find(key);
+    if (it == shard.scores.end()) return false;
+    *score = it->second;
+    return true;
+}
+
+void StoreCityScore(CityScoreCache * cache, const CityKey& key, const CityScore& score) {
+    CityScoreCache::Shard& shard = cache->shards[CityKeyHash()(key) % cityScoreShards];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.scores.emplace(key, score);
+}
+
+// Evaluate one chunk of the grid and fold it into the worker's reductions. A bound tracks the
+// incumbent: with prune, a strategy whose tc exceeds the lower of the bound and the chunk's
+// running best skips the surge scoring; its damage and breach frequency are NaN and it is left
+// out of the reductions, and no strategy enters the Pareto archive. With adaptive, each strategy is scored by SimulateSurgeBlockAdaptive
+// against the same incumbent. sequenceCol receives the sequences scored per strategy. With a
+// cities cache, a strategy whose city may alias another takes that city's score when it was
+// already scored (see CityKey). An infeasible strategy (see StrategyFeasible) is never scored
+// against the surges: its damage is +inf, its breach frequency NaN, and it is left out of the
+// reductions and the bound.
+void SweepEvaluateChunk(const SweepGrid& grid, const SurgeBlock * surges, int64_t first, int n,
+                        double * levers, int * caseCol, int * sequenceCol, double * cols, SequenceDamage seq,
+                        DikeCostCache * dikeCache, const ResistanceFractionTable * fractions,
+                        const ColumnFile * rows, SweepBound * bound, bool prune, const AdaptiveStopping * adaptive,
+                        CityScoreCache * cities, SweepWorker& w) {
+    double * W = levers, * R = levers + n, * P = levers + 2*n, * D = levers + 3*n, * B = levers + 4*n;
+    double * damageCol = levers + 5*n, * breachCol = levers + 6*n, * prunedCol = levers + 7*n;
+    for (int i = 0; i < n; i++) {
+        int64_t index = first + i;
+        B[i] = grid.B.Value(index % grid.B.count); index /= grid.B.count;
+        D[i] = grid.D.Value(index % grid.D.count); index /= grid.D.count;
+        P[i] = grid.P.Value(index % grid.P.count); index /= grid.P.count;
+        R[i] = grid.R.Value(index % grid.R.count); index /= grid.R.count;
+        W[i] = grid.W.Value(index);
+    }
+    CityColumns out = {caseCol, cols, cols + n, cols + 2*n, cols + 3*n, cols + 4*n, cols + 5*n, cols + 6*n,
+                       cols + 7*n, cols + 8*n, cols + 9*n, cols + 10*n, cols + 11*n, cols + 12*n};
+    int64_t start = StageClock();
+    CharacterizeCityBatchWithDikeCache(n, W, B, R, P, D, out, dikeCache);
+    RecordStage(&w.stats, stageCharacterize, start);
+    CountCases(&w.stats, caseCol, n);
+    // B is the fastest axis, so a chunk spans few withdrawal heights
+    start = StageClock();
+    WithdrawalStage stage;
+    PrepareWithdrawal(W[0], &stage);
+    double stagedW = W[0];
+    bool tracked = surges && bound;
+    prune = prune && tracked;
+    double chunkBest = tracked ? bound->totalCost.load(std::memory_order_relaxed) : INFINITY;
+    // the worker's first feasible strategy is always scored, so that it has a best
+    bool scored = SweepHasBest(w);
+    if (tracked && scored) chunkBest = std::min(chunkBest, w.best.totalCost);
+    for (int i = 0; i < n; i++) {
+        double damage = 0, breaches = 0;
+        bool feasible = StrategyFeasible(W[i], B[i], D[i]);
+        prunedCol[i] = (prune && feasible && scored && out.tc[i] > chunkBest) ? 1 : 0;
+        sequenceCol[i] = 0;
+        if (!feasible) {
+            damage = INFINITY;
+            breaches = NAN;
+        } else if (prunedCol[i] > 0) {
+            damage = NAN;
+            breaches = NAN;
+        } else if (surges) {
+            // the damage kernels need the full city characterization
+            double cityChar[numCityChar];
+            memset(cityChar, 0, sizeof(cityChar));
+            if (W[i] != stagedW) { PrepareWithdrawal(W[i], &stage); stagedW = W[i]; }
+            CharacterizeCityStaged(&stage, dikeCache, fractions, B[i], R[i], P[i], D[i], cityChar);
+            bool lookup = cities && CityMayAlias(cityChar);
+            CityKey key;
+            CityScore cached;
+            if (lookup) key = MakeCityKey(cityChar);
+            if (lookup && FindCityScore(cities, key, &cached)) {
+                damage = cached.damage;
+                breaches = cached.breachFrequency;
+                sequenceCol[i] = cached.sequences;
+                w.deduplicated++;
+            } else {
+                if (adaptive) {
+                    AdaptiveScore score = SimulateSurgeBlockAdaptive(cityChar, surges, seq, *adaptive, chunkBest);
+                    damage = score.damage;
+                    breaches = score.breachFrequency;
+                    sequenceCol[i] = score.sequences;
+                } else {
+                    SimulateSurgeBlock(cityChar, surges, seq);
+                    for (int s = 0; s < surges->numSequences; s++) {
+                        damage += seq.damage[s];
+                        breaches += seq.breachEvents[s];
+                    }
+                    damage /= surges->numSequences;
+                    breaches /= (double)surges->numSequences * surges->numYears;
+                    sequenceCol[i] = surges->numSequences;
+                }
+                if (lookup) StoreCityScore(cities, key, {damage, breaches, sequenceCol[i]});
+            }
+            if (tracked) chunkBest = std::min(chunkBest, out.tc[i] + damage);
+        }
+        scored = scored || (feasible && prunedCol[i] == 0);
+        damageCol[i] = damage;
+        breachCol[i] = breaches;
+    }
+    if (surges) RecordStage(&w.stats, stageDamage, start);
+    start = StageClock();
+    for (int i = 0; i < n; i++) {
+        if (!StrategyFeasible(W[i], B[i], D[i])) {
+            w.infeasible++;
+        } else if (prunedCol[i] > 0) {
+            w.pruned++;
+        } else {
+            SweepCandidate c = {first + i, W[i], R[i], P[i], D[i], B[i], out.tic[i], damageCol[i], breachCol[i],
+                                out.tc[i] + damageCol[i], sequenceCol[i]};
+            w.sequencesScored += sequenceCol[i];
+            if (!SweepHasBest(w) || SweepBetter(c, w.best)) w.best = c;
+            if (!prune) ParetoInsert(w.front, c);
+        }
+        w.evaluated++;
+    }
+    if (tracked && SweepHasBest(w)) LowerSweepBound(bound, w.best.totalCost);
+
+    RecordStage(&w.stats, stageReduce, start);
+    if (rows) {
+        // columns in sweepColumns order: the five levers, caseNum, the 13 batch columns, the two
+        // scores and the sequences they used
+        const void * values[numSweepColumns] = {W, R, P, D, B, out.caseNum, out.wc, out.rc, out.dc, out.tic, out.tc,
+                                                out.vz1, out.vz2, out.vz3, out.vz4, out.tz1, out.tz2, out.tz3, out.tz4,
+                                                damageCol, breachCol, sequenceCol};
+        for (int k = 0; k < numSweepColumns; k++) w.rowsWritten = WriteColumn(rows, k, first, n, values[k]) && w.rowsWritten;
+    }
+}
+
+// ---- checkpoints ----
+
+// rows of the candidate columns of a checkpoint
+void AddCandidateColumns(CheckpointData * data, const vector<SweepCandidate>& candidates) {
+    size_t n = candidates.size();
+    vector<int64_t> index(n);
+    vector<double> values[9];
+    vector<int> sequences(n);
+    for (auto& v : values) v.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        const SweepCandidate& c = candidates[i];
+        const double row[9] = {c.W, c.R, c.P, c.D, c.B, c.tic, c.damage, c.breachFrequency, c.totalCost};
+        for (int k = 0; k < 9; k++) values[k][i] = row[k];
+        index[i] = c.index;
+        sequences[i] = c.sequences;
+    }
+    const char * const names[9] = {"W", "R", "P", "D", "B", "tic", "damage", "breachFrequency", "totalCost"};
+    AddCheckpointColumn(data, "index", columnInt64, index);
+    for (int k = 0; k < 9; k++) AddCheckpointColumn(data, names[k], columnFloat64, values[k]);
+    AddCheckpointColumn(data, "sequences", columnInt32, sequences);
+}
+
+bool ReadCandidateColumns(const ColumnFileView * view, size_t n, vector<SweepCandidate> * candidates) {
+    vector<int64_t> index;
+    vector<double> values[9];
+    vector<int> sequences;
+    const char * const names[9] = {"W", "R", "P", "D", "B", "tic", "damage", "breachFrequency", "totalCost"};
+    bool ok = ReadCheckpointColumn(view, "index", columnInt64, n, &index) &&
+              ReadCheckpointColumn(view, "sequences", columnInt32, n, &sequences);
+    for (int k = 0; ok && k < 9; k++) ok = ReadCheckpointColumn(view, names[k], columnFloat64, n, &values[k]);
+    if (!ok) return false;
+    candidates->resize(n);
+    for (size_t i = 0; i < n; i++) {
+        (*candidates)[i] = {index[i], values[0][i], values[1][i], values[2][i], values[3][i], values[4][i],
+                            values[5][i], values[6][i], values[7][i], values[8][i], sequences[i]};
+    }
+    return true;
+}
+
+// Where and how often SweepStrategies saves its progress. surgeSeed and firstSequence identify
+// the surge block (its generator seed and first sequence), which a resumed sweep must be given
+// again; a checkpoint of one block does not resume against another.
+struct SweepProgress;
+struct SweepCheckpoint {
+    const char * path = NULL;
+    double intervalSeconds = 60;            // between checkpoints; 0 saves after every chunk
+    const SweepProgress * resume = NULL;    // LoadSweepCheckpoint result to continue from
+    int64_t maxChunks = 0;                  // stop after this many chunks (0: no limit) and leave the rest
+    uint64_t surgeSeed = 0;
+    uint64_t firstSequence = 0;
+};
+
+// The reductions over some set of finished chunks: a worker's, or all of a checkpoint's
+struct SweepSnapshot {
+    SweepCandidate best;                    // valid when SweepHasBest
+    vector<SweepCandidate> members;         // Pareto archive, in no particular order
+    int64_t evaluated = 0;
+    int64_t pruned = 0;
+    int64_t infeasible = 0;
+    int64_t sequencesScored = 0;
+};
+
+struct SweepProgress {
+    SweepSnapshot state;
+    vector<int> chunkDone;                  // 1 for each chunk of sweepChunk strategies in state
+};
+
+// meta of a sweep checkpoint after the common entries; settings holds the five grid axes
+// (min, step, count) and the three epsilons
+const int metaGridSize = 5;
+const int metaChunks = 6;
+const int metaEvaluated = 7;
+const int metaPruned = 8;
+const int metaSequencesScored = 9;
+const int metaHasBest = 10;
+const int metaInfeasible = 11;
+const int numSweepMeta = 12;
+const int numSweepSettings = 18;
+
+void SweepSettings(const SweepGrid& grid, const ParetoEpsilon& epsilon, vector<double> * settings) {
+    settings->clear();
+    for (const LeverAxis * axis : {&grid.W, &grid.R, &grid.P, &grid.D, &grid.B}) {
+        settings->push_back(axis->min);
+        settings->push_back(axis->step);
+        settings->push_back(axis->count);
+    }
+    settings->push_back(epsilon.tic);
+    settings->push_back(epsilon.damage);
+    settings->push_back(epsilon.breachFrequency);
+}
+
+void AddSweepProgress(CheckpointData * data, const SweepGrid& grid, const ParetoEpsilon& epsilon,
+                      const SweepCheckpoint& checkpoint, int numSequences, const SweepProgress& progress) {
+    const SweepSnapshot& s = progress.state;
+    bool hasBest = SweepHasBest(s);
+    vector<SweepCandidate> candidates = s.members;
+    if (hasBest) candidates.push_back(s.best);   // the best is the last row
+    vector<int64_t> meta = {sweepCheckpointKind, (int64_t)candidates.size(), (int64_t)checkpoint.surgeSeed,
+                            (int64_t)checkpoint.firstSequence, numSequences, grid.Size(),
+                            (int64_t)progress.chunkDone.size(), s.evaluated, s.pruned, s.sequencesScored, hasBest,
+                            s.infeasible};
+    vector<double> settings;
+    SweepSettings(grid, epsilon, &settings);
+    AddCheckpointColumn(data, "meta", columnInt64, meta);
+    AddCheckpointColumn(data, "settings", columnFloat64, settings);
+    AddCheckpointColumn(data, "chunkDone", columnInt32, progress.chunkDone);
+    AddCandidateColumns(data, candidates);
+}
+
+// Read the sweep checkpoint at path into progress, checking that it was written by a sweep of
+// this grid, epsilon and surge block (numSequences -1 for none)
+bool LoadSweepCheckpoint(const char * path, const SweepGrid& grid, const ParetoEpsilon& epsilon,
+                         const SweepCheckpoint& checkpoint, int numSequences, SweepProgress * progress) {
+    ColumnFileView view;
+    vector<int64_t> meta;
+    if (!OpenCheckpointFile(path, sweepCheckpointKind, numSweepMeta, &view, &meta)) return false;
+    vector<double> settings, expected;
+    SweepSettings(grid, epsilon, &expected);
+    int64_t numChunks = (grid.Size() + sweepChunk - 1) / sweepChunk;
+    bool ok = ReadCheckpointColumn(&view, "settings", columnFloat64, numSweepSettings, &settings) && settings == expected &&
+              meta[metaGridSize] == grid.Size() && meta[metaChunks] == numChunks &&
+              meta[metaSurgeSeed] == (int64_t)checkpoint.surgeSeed &&
+              meta[metaFirstSequence] == (int64_t)checkpoint.firstSequence && meta[metaNumSequences] == numSequences;
+    if (!ok) {
+        cerr << "Checkpoint " << path << " is of a different grid, epsilon or surge block\n";
+        CloseColumnFileView(&view);
+        return false;
+    }
+    vector<SweepCandidate> candidates;
+    ok = ReadCheckpointColumn(&view, "chunkDone", columnInt32, numChunks, &progress->chunkDone) &&
+         ReadCandidateColumns(&view, meta[metaCandidates], &candidates) &&
+         (int64_t)candidates.size() >= meta[metaHasBest];
+    CloseColumnFileView(&view);
+    if (!ok) {
+        cerr << "Checkpoint " << path << " is truncated\n";
+        return false;
+    }
+    SweepSnapshot& s = progress->state;
+    if (meta[metaHasBest]) {
+        s.best = candidates.back();
+        candidates.pop_back();
+    }
+    s.members.swap(candidates);
+    s.evaluated = meta[metaEvaluated];
+    s.pruned = meta[metaPruned];
+    s.infeasible = meta[metaInfeasible];
+    s.sequencesScored = meta[metaSequencesScored];
+    return true;
+}
+
+// What the workers have saved for the checkpoint writer, guarded by mutex. A worker copies its
+// reductions into its slot and marks the chunks they cover in chunkDone in one step, so whenever
+// the writer copies the lot, each chunk marked done is counted in exactly one slot.
+struct SweepSnapshots {
+    std::mutex mutex;
+    vector<SweepSnapshot> slots;
+    vector<int> chunkDone;
+    std::atomic<int64_t> nextCheckpoint;    // CheckpointClock time of the next write
+    int64_t interval;                       // ns
+};
+
+void SaveSweepSnapshot(SweepSnapshots * snapshots, int t, SweepWorker& w) {
+    std::lock_guard<std::mutex> lock(snapshots->mutex);
+    SweepSnapshot& s = snapshots->slots[t];
+    s.best = w.best;
+    s.members = w.front.members;
+    s.evaluated = w.evaluated;
+    s.pruned = w.pruned;
+    s.infeasible = w.infeasible;
+    s.sequencesScored = w.sequencesScored;
+    for (uint32_t chunk : w.unsaved) snapshots->chunkDone[chunk] = 1;
+    w.unsaved.clear();
+}
+
+// Merge the saved slots into one progress (on the writer thread). Rows of the finished chunks
+// went to the column file before the chunks were marked done; they are synced first, so a
+// checkpoint never covers rows that a crash could lose.
+bool CollectSweepProgress(SweepSnapshots * snapshots, const ParetoEpsilon& epsilon, const ColumnFile * rows,
+                          SweepProgress * progress) {
+    vector<SweepSnapshot> slots;
+    {
+        std::lock_guard<std::mutex> lock(snapshots->mutex);
+        slots = snapshots->slots;
+        progress->chunkDone = snapshots->chunkDone;
+    }
+    if (rows && fdatasync(rows->fd) != 0) return false;
+    ParetoArchive front;
+    front.epsilon = epsilon;
+    SweepSnapshot& merged = progress->state;
+    for (const SweepSnapshot& s : slots) {
+        if (SweepHasBest(s) && (!SweepHasBest(merged) || SweepBetter(s.best, merged.best))) merged.best = s.best;
+        for (const auto& c : s.members) ParetoInsert(front, c);
+        merged.evaluated += s.evaluated;
+        merged.pruned += s.pruned;
+        merged.infeasible += s.infeasible;
+        merged.sequencesScored += s.sequencesScored;
+    }
+    merged.members.swap(front.members);
+    SortByInvestment(merged.members);
+    return true;
+}
+
+// Evaluate every strategy of the grid on numThreads threads (0: one per hardware thread),
+// scoring damage against surges when it is not NULL. Chunks of sweepChunk strategies are
+// split evenly between threads up front and rebalanced by work stealing; each thread keeps
+// its own best strategy and Pareto archive, merged once all threads have finished.
+// When rows is not NULL, each strategy is also written to that file (created with sweepColumns
+// and grid.Size() rows) at the row of its grid index.
+// Infeasible strategies (see StrategyFeasible) are written to rows but never scored, and are
+// neither the best nor in the Pareto archive; infeasible counts them.
+// With prune, strategies that provably cannot have the lowest total cost skip the surge scoring
+// (see SweepBound); the best strategy is unchanged. Total cost says nothing about the other
+// objectives, so a pruned strategy may be non-dominated: no archive is kept, pareto is empty
+// and paretoValid is false.
+// With adaptive, each strategy stops scoring once its damage is known well enough (see
+// AdaptiveStopping) and its candidate records the sequences used. Damage is then a statistical
+// estimate, and with stopWorse the sequences used depend on the order strategies are scored in,
+// so results can differ between thread counts.
+// Strategies with the same effective levers as one already scored take its score instead of
+// scoring the surges again (see CityKey), except with adaptive stopWorse; the results are
+// unchanged, and deduplicated counts them. Their candidates record the sequences of that score.
+// With checkpoint, the finished chunks and their reductions are saved to checkpoint->path every
+// intervalSeconds by a CheckpointWriter, and once more at the end. Workers only copy their
+// reductions into a snapshot slot; merging and writing happen on the writer's thread. A sweep
+// resumed from a checkpoint skips its chunks and starts from its best and archive, and ends
+// with the same best and Pareto archive as an uninterrupted sweep (except with prune or
+// adaptive, whose results depend on the scoring order anyway).
+SweepResult SweepStrategies(const SweepGrid& grid, const SurgeBlock * surges, int numThreads,
+                            const ParetoEpsilon& epsilon = ParetoEpsilon(), const ColumnFile * rows = NULL,
+                            bool prune = false, const AdaptiveStopping * adaptive = NULL,
+                            const SweepCheckpoint * checkpoint = NULL) {
+    if (numThreads <= 0) numThreads = std::max(1u, std::thread::hardware_concurrency());
+    int64_t size = grid.Size();
+    uint32_t numChunks = (uint32_t)((size + sweepChunk - 1) / sweepChunk);
+    const SweepProgress * resume = checkpoint ? checkpoint->resume : NULL;
+    // with a resume, the workers share out the chunks it did not finish
+    vector<uint32_t> todo;
+    for (uint32_t chunk = 0; resume && chunk < numChunks; chunk++)
+        if (!resume->chunkDone[chunk]) todo.push_back(chunk);
+    uint32_t numTodo = resume ? (uint32_t)todo.size() : numChunks;
+    std::unique_ptr<SweepWorker[]> workers(new SweepWorker[numThreads]);
+    for (int t = 0; t < numThreads; t++) {
+        workers[t].range.store(SweepRange((uint32_t)((uint64_t)numTodo * t / numThreads),
+                                          (uint32_t)((uint64_t)numTodo * (t + 1) / numThreads)));
+        workers[t].evaluated = 0;
+        workers[t].pruned = 0;
+        workers[t].infeasible = 0;
+        workers[t].sequencesScored = 0;
+        workers[t].deduplicated = 0;
+        workers[t].front.epsilon = epsilon;
+        workers[t].rowsWritten = true;
+        workers[t].nextSnapshot = 0;
+        ClearSweepStats(&workers[t].stats);
+        if (!InitEvaluationArena(&workers[t].arena, SweepScratchBytes(surges))) throw std::bad_alloc();
+    }
+    if (resume) {
+        // worker 0 carries on from the checkpoint's reductions
+        const SweepSnapshot& s = resume->state;
+        workers[0].best = s.best;
+        workers[0].front.members = s.members;
+        workers[0].evaluated = s.evaluated;
+        workers[0].pruned = s.pruned;
+        workers[0].infeasible = s.infeasible;
+        workers[0].sequencesScored = s.sequencesScored;
+    }
+    std::unique_ptr<SweepSnapshots> snapshots;
+    CheckpointWriter writer;
+    std::atomic<int64_t> chunkBudget(checkpoint && checkpoint->maxChunks > 0 ? checkpoint->maxChunks : INT64_MAX);
+    int numSequences = surges ? surges->numSequences : -1;
+    auto writeCheckpoint = [&]() {
+        SweepSnapshots * shared = snapshots.get();
+        SubmitCheckpoint(&writer, [=, &grid, &epsilon](CheckpointData * data) {
+            SweepProgress progress;
+            if (!CollectSweepProgress(shared, epsilon, rows, &progress)) return false;
+            AddSweepProgress(data, grid, epsilon, *checkpoint, numSequences, progress);
+            return true;
+        });
+    };
+    if (checkpoint) {
+        snapshots.reset(new SweepSnapshots);
+        snapshots->slots.resize(numThreads);
+        snapshots->chunkDone = resume ? resume->chunkDone : vector<int>(numChunks, 0);
+        if (resume) snapshots->slots[0] = resume->state;
+        snapshots->interval = (int64_t)(checkpoint->intervalSeconds * 1e9);
+        snapshots->nextCheckpoint.store(CheckpointClock() + snapshots->interval);
+        StartCheckpointWriter(&writer, checkpoint->path);
+    }
+    // fcR for every P on the grid, read-only and shared by all threads
+    vector<double> pValues(grid.P.count);
+    for (int k = 0; k < grid.P.count; k++) pValues[k] = grid.P.Value(k);
+    ResistanceFractionTable fractions;
+    BuildResistanceFractionTable(grid.P.count, pValues.data(), &fractions);
+    // a score depends only on the city unless adaptive stopping compares it with the incumbent
+    std::unique_ptr<CityScoreCache> cities;
+    if (surges && !(adaptive && adaptive->stopWorse)) cities.reset(new CityScoreCache);
+    SweepBound bound;
+    bound.totalCost.store((resume && SweepHasBest(resume->state)) ? resume->state.best.totalCost : INFINITY);
+
+    auto work = [&](int t) {
+        SweepWorker& w = workers[t];
+        // scratch for one chunk and one strategy's surge totals, allocated once per thread
+        EvaluationArena& arena = w.arena;
+        double * levers = ArenaAlloc<double>(&arena, 8 * sweepChunk);
+        double * cols = ArenaAlloc<double>(&arena, 13 * sweepChunk);
+        int * caseCol = ArenaAlloc<int>(&arena, sweepChunk);
+        int * sequenceCol = ArenaAlloc<int>(&arena, sweepChunk);
+        SequenceDamage seq = {};
+        if (surges) ArenaSequenceDamage(&arena, surges->numSequences, &seq);
+        DikeCostCache dikeCache;
+        InitDikeCostCache(&cityDikeCost, &dikeCache);
+        uint32_t position;
+        while (SweepPopChunk(w, position) || (SweepSteal(workers.get(), numThreads, t) && SweepPopChunk(w, position))) {
+            if (chunkBudget.fetch_sub(1) <= 0) break;
+            uint32_t chunk = resume ? todo[position] : position;
+            int64_t first = (int64_t)chunk * sweepChunk;
+            int n = (int)std::min<int64_t>(sweepChunk, size - first);
+            SweepEvaluateChunk(grid, surges, first, n, levers, caseCol, sequenceCol, cols, seq, &dikeCache, &fractions,
+                               rows, (prune || adaptive) ? &bound : NULL, prune, adaptive, cities.get(), w);
+            if (!snapshots) continue;
+            w.unsaved.push_back(chunk);
+            int64_t now = CheckpointClock();
+            if (now >= w.nextSnapshot) {
+                SaveSweepSnapshot(snapshots.get(), t, w);
+                w.nextSnapshot = now + snapshots->interval;
+            }
+            // one worker per interval hands the slots to the writer
+            int64_t due = snapshots->nextCheckpoint.load();
+            if (now >= due && snapshots->nextCheckpoint.compare_exchange_strong(due, now + snapshots->interval))
+                writeCheckpoint();
+        }
+        if (snapshots) SaveSweepSnapshot(snapshots.get(), t, w);
+    };
+    vector<std::thread> threads;
+    for (int t = 1; t < numThreads; t++) threads.emplace_back(work, t);
+    work(0);
+    for (auto& th : threads) th.join();
+
+    SweepResult result;
+    result.checkpointed = true;
+    result.paretoValid = !(prune && surges);
+    if (checkpoint) {
+        writeCheckpoint();
+        result.checkpointed = StopCheckpointWriter(&writer);
+    }
+    result.best = SweepCandidate();
+    result.best.index = -1;
+    result.best.totalCost = INFINITY;
+    result.evaluated = 0;
+    result.pruned = 0;
+    result.infeasible = 0;
+    result.sequencesScored = 0;
+    result.deduplicated = 0;
+    result.scratchBytes = 0;
+    result.numThreads = numThreads;
+    result.rowsWritten = true;
+    ClearSweepStats(&result.stats);
+    ParetoArchive front;
+    front.epsilon = epsilon;
+    for (int t = 0; t < numThreads; t++) {
+        const SweepWorker& w = workers[t];
+        if (w.evaluated == 0) continue;
+        if (SweepHasBest(w) && (!SweepHasBest(result) || SweepBetter(w.best, result.best))) result.best = w.best;
+        ParetoMerge(front, w.front);
+        result.evaluated += w.evaluated;
+        result.pruned += w.pruned;
+        result.infeasible += w.infeasible;
+        result.sequencesScored += w.sequencesScored;
+        result.deduplicated += w.deduplicated;
+        result.scratchBytes += w.arena.peak;
+        result.rowsWritten = result.rowsWritten && w.rowsWritten;
+        MergeSweepStats(&result.stats, &w.stats);
+    }
+    AddProcessSweepStats(&result.stats);
+    for (int t = 0; t < numThreads; t++) FreeEvaluationArena(&workers[t].arena);
+    result.pareto.swap(front.members);
+    SortByInvestment(result.pareto);
+    return result;
+}
+
+
+// ========================================
+// DYNAMIC STRATEGIES
+// ========================================
+
+// A lever request of a dynamic strategy: from year on (0 = the first simulated year) the
+// levers are raised to at least W, R, P, D, B. Defenses never decrease: each request is merged
+// into the standing levers by element-wise max, like Base.max on FloodDefenses in
+// src/Stochastic/simulation.jl. Unused levers are 0 (a baseValue sentinel would stick).
+struct LeverChange {
+    int year;
+    double W, R, P, D, B;
+};
+
+// the city between two lever changes, characterized once
+struct DynamicEpoch {
+    int firstYear;           // the epoch covers [firstYear, next epoch's firstYear)
+    double cityChar[numCityChar];
+    double investment;       // max(0, tic - tic of the previous epoch), paid in firstYear
+};
+
+// Merge the requests (sorted by year) into epochs, one per year in which the standing levers
+// change. The city is only re-characterized at those years; the first epoch starts at year 0
+// with no defenses.
+vector<DynamicEpoch> DynamicEpochs(const LeverChange * changes, int numChanges, int numYears) {
+    vector<DynamicEpoch> epochs(1);
+    double levers[5] = {0, 0, 0, 0, 0};   // W, R, P, D, B
+    epochs[0].firstYear = 0;
+    memset(epochs[0].cityChar, 0, sizeof(epochs[0].cityChar));
+    CharacterizeCity(0, 0, 0, 0, 0, epochs[0].cityChar);
+    epochs[0].investment = 0;
+    for (int k = 0; k < numChanges && changes[k].year < numYears; k++) {
+        const LeverChange& c = changes[k];
+        double raised[5] = {std::max(levers[0], c.W), std::max(levers[1], c.R), std::max(levers[2], c.P),
+                            std::max(levers[3], c.D), std::max(levers[4], c.B)};
+        if (memcmp(raised, levers, sizeof(levers)) == 0) continue;
+        memcpy(levers, raised, sizeof(levers));
+        if (epochs.back().firstYear != std::max(0, c.year)) {
+            epochs.push_back(DynamicEpoch());
+            epochs.back().firstYear = std::max(0, c.year);
+        }
+        DynamicEpoch& e = epochs.back();
+        double previousTic = (epochs.size() > 1) ? epochs[epochs.size() - 2].cityChar[tic] : 0;
+        memset(e.cityChar, 0, sizeof(e.cityChar));
+        CharacterizeCity(levers[0], levers[4], levers[1], levers[2], levers[3], e.cityChar);
+        e.investment = std::max(0.0, e.cityChar[tic] - previousTic);
+    }
+    return epochs;
+}
+
+// discount factor of year y (0-based), costs discounted at the end of the year like
+// compute_outcome in src/Stochastic/simulation.jl
+inline double DynamicDiscount(double discountRate, int year) {
+    return 1 / pow(1 + discountRate, year + 1);
+}
+
+struct DynamicOutcome {
+    double investment;        // discounted incremental investment, the same for every sequence
+    int numEpochs;            // distinct lever settings over the horizon, no defenses included
+};
+
+// Simulate the dynamic strategy over every sequence of block. Year y of sequence s sees the
+// surge plus meanSeaLevel[y] (NULL for none) against the epoch holding y, with the dike failing
+// when the uniform at counter (y, firstSequence+s, breachStream) of gen is below the failure
+// probability, as in SampleDikeFailures. damage[s] receives the discounted damage of sequence s.
+// Every epoch's city is scored in tiles of surgeTile sequences with CalculateDamageBlock, so
+// the cost per year is that of a static strategy.
+DynamicOutcome SimulateDynamicStrategy(const LeverChange * changes, int numChanges, const SurgeGenerator * gen,
+                                       uint64_t firstSequence, const SurgeBlock * block, const double * meanSeaLevel,
+                                       double discountRate, double * damage) {
+    int nS = block->numSequences, nY = block->numYears;
+    vector<DynamicEpoch> epochs = DynamicEpochs(changes, numChanges, nY);
+    DynamicOutcome outcome = {0, (int)epochs.size()};
+    for (const DynamicEpoch& e : epochs) outcome.investment += e.investment * DynamicDiscount(discountRate, e.firstYear);
+
+    double surge[surgeTile], scratch[dvLength * surgeTile];
+    for (int s0 = 0; s0 < nS; s0 += surgeTile) {
+        int m = std::min(surgeTile, nS - s0);
+        for (int j = 0; j < m; j++) damage[s0 + j] = 0;
+        for (size_t k = 0; k < epochs.size(); k++) {
+            const double * cityChar = epochs[k].cityChar;
+            int lastYear = (k + 1 < epochs.size()) ? epochs[k + 1].firstYear : nY;
+            for (int y = epochs[k].firstYear; y < lastYear; y++) {
+                double msl = meanSeaLevel ? meanSeaLevel[y] : 0;
+                uint64_t mask = 0;
+                for (int j = 0; j < m; j++) {
+                    int sq = s0 + j;
+                    surge[j] = ((block->layout == yearMajor) ? block->surge[(size_t)y * nS + sq] : block->surge[(size_t)sq * nY + y]) + msl;
+                    double u0, u1;
+                    CounterUniforms(gen->seed, breachStream, firstSequence + sq, y, &u0, &u1);
+                    mask |= (uint64_t)(u0 < DikeFailureProbability(SurgeAtDike(cityChar, surge[j]), cityChar[dh])) << j;
+                }
+                CalculateDamageBlock(cityChar, m, surge, &mask, scratch);
+                double df = DynamicDiscount(discountRate, y);
+                for (int j = 0; j < m; j++) damage[s0 + j] += scratch[dvt * m + j] * df;
+            }
+        }
+    }
+    return outcome;
+}
+
+
+// ========================================
+// POLICY SEARCH
+// ========================================
+
+// Separable CMA-ES (Ros and Hansen, 2008): a (mu/mu_w, lambda) evolution strategy with a
+// diagonal covariance, cumulative step-size adaptation and rank-one plus rank-mu updates.
+// It searches the unit cube of the policy fractions of StaticPolicy in src/ICOW.jl, which map
+// to levers that always satisfy is_feasible (W + B + D <= CEC); the lever rules of
+// CharacterizeCity (minHeight, a dike too close to the withdrawal) then apply as usual.
+const int numPolicyFractions = 5;     // a_frac, w_frac, b_frac, r_frac, P
+const uint32_t optimiserStream = 3;
+constexpr double maxResistancePercentage = 0.99;   // P < 1, keeping 1/(1-P) finite
+
+struct OptimiserState;
+struct OptimiserOptions {
+    uint64_t seed;
+    int populationSize;     // lambda; 0 for 4 + 3 ln 5 (8)
+    int maxGenerations;
+    double initialSigma;    // step size in the unit cube
+    double minSigma;        // stop once sigma times the largest axis falls below this
+    int numThreads;         // for the surge scoring; 0 for one per hardware thread
+    const char * checkpointPath = NULL;     // save the state here every checkpointEvery generations and at the end
+    int checkpointEvery = 0;                // 0 for the end only
+    const OptimiserState * resume = NULL;   // LoadOptimiserCheckpoint result to continue from
+};
+
+// Everything a run carries from one generation to the next. The samples of a generation
+// depend only on the seed and its number, so a run resumed from the state after generation g
+// continues exactly as the uninterrupted run would have.
+struct OptimiserState {
+    int generation;         // generations done
+    int64_t evaluations;
+    bool converged;         // the step size fell below minSigma
+    double sigma;
+    double mean[numPolicyFractions], diagC[numPolicyFractions], pSigma[numPolicyFractions], pc[numPolicyFractions];
+    SweepCandidate best;    // index -1 before any evaluation
+    double fractions[numPolicyFractions];
+};
+
+// meta of an optimiser checkpoint after the common entries; settings holds sigma, mean, diagC,
+// pSigma, pc and the best's fractions, and the candidate columns the best
+const int metaLambda = 5;
+const int metaOptimiserSeed = 6;
+const int metaGeneration = 7;
+const int metaEvaluations = 8;
+const int metaConverged = 9;
+const int metaOptimiserHasBest = 10;
+const int numOptimiserMeta = 11;
+const int numOptimiserSettings = 1 + 5 * numPolicyFractions;
+
+void AddOptimiserState(CheckpointData * data, int lambda, uint64_t seed, const SurgeBlock * surges,
+                       const SurgeGenerator * breachDraws, uint64_t firstSequence, const OptimiserState& state) {
+    bool hasBest = state.best.index >= 0;
+    vector<int64_t> meta = {optimiserCheckpointKind, hasBest, breachDraws ? (int64_t)breachDraws->seed : 0,
+                            (int64_t)firstSequence, surges ? surges->numSequences : -1, lambda, (int64_t)seed,
+                            state.generation, state.evaluations, state.converged, hasBest};
+    vector<double> settings(1, state.sigma);
+    for (const double * v : {state.mean, state.diagC, state.pSigma, state.pc, state.fractions})
+        settings.insert(settings.end(), v, v + numPolicyFractions);
+    AddCheckpointColumn(data, "meta", columnInt64, meta);
+    AddCheckpointColumn(data, "settings", columnFloat64, settings);
+    AddCandidateColumns(data, vector<SweepCandidate>(hasBest ? 1 : 0, state.best));
+}
+
+// Read the optimiser checkpoint at path into state, checking that it was written by a run with
+// the same population, seed, surge block and breach draws
+bool LoadOptimiserCheckpoint(const char * path, const SurgeBlock * surges, const SurgeGenerator * breachDraws,
+                             uint64_t firstSequence, const OptimiserOptions& options, OptimiserState * state) {
+    ColumnFileView view;
+    vector<int64_t> meta;
+    if (!OpenCheckpointFile(path, optimiserCheckpointKind, numOptimiserMeta, &view, &meta)) return false;
+    int lambda = options.populationSize > 0 ? options.populationSize : 4 + (int)(3 * log((double)numPolicyFractions));
+    bool ok = meta[metaLambda] == lambda && meta[metaOptimiserSeed] == (int64_t)options.seed &&
+              meta[metaSurgeSeed] == (breachDraws ? (int64_t)breachDraws->seed : 0) &&
+              meta[metaFirstSequence] == (int64_t)firstSequence &&
+              meta[metaNumSequences] == (surges ? surges->numSequences : -1);
+    if (!ok) {
+        cerr << "Checkpoint " << path << " is of a different population, seed or surge block\n";
+        CloseColumnFileView(&view);
+        return false;
+    }
+    vector<double> settings;
+    vector<SweepCandidate> best;
+    ok = ReadCheckpointColumn(&view, "settings", columnFloat64, numOptimiserSettings, &settings) &&
+         ReadCandidateColumns(&view, meta[metaOptimiserHasBest], &best);
+    CloseColumnFileView(&view);
+    if (!ok) {
+        cerr << "Checkpoint " << path << " is truncated\n";
+        return false;
+    }
+    state->generation = (int)meta[metaGeneration];
+    state->evaluations = meta[metaEvaluations];
+    state->converged = meta[metaConverged] != 0;
+    state->sigma = settings[0];
+    double * v[5] = {state->mean, state->diagC, state->pSigma, state->pc, state->fractions};
+    for (int k = 0; k < 5; k++) std::copy(&settings[1 + k * numPolicyFractions], &settings[1 + (k + 1) * numPolicyFractions], v[k]);
+    if (!best.empty()) {
+        state->best = best[0];
+    } else {
+        state->best.totalCost = INFINITY;
+        state->best.index = -1;
+    }
+    return true;
+}
+
+struct OptimiserResult {
+    SweepCandidate best;    // lowest total cost evaluated; index counts evaluations
+    double fractions[numPolicyFractions];
+    int generations;
+    int64_t evaluations;
+    bool checkpointed = true;   // every checkpoint was written, if a checkpointPath was given
+    bool scored = true;         // false if an arena was too small and the search stopped early
+};
+
+// ICOW.jl FloodDefenses(policy): A = a*CEC, W = w*A, B = b*(A - W), D = A - W - B, R = r*CEC
+void PolicyLevers(const double * x, double& W, double& R, double& P, double& D, double& B) {
+    double A = x[0] * CEC;
+    W = x[1] * A;
+    double remaining = A - W;
+    B = x[2] * remaining;
+    D = remaining - B;
+    R = x[3] * CEC;
+    P = x[4] * maxResistancePercentage;
+}
+
+// standard normal k of the sample at counter (sequence, pair) of the optimiser stream (Box-Muller)
+inline double OptimiserNormal(uint64_t seed, uint64_t sequence, uint32_t pair, int k) {
+    const double pi = 3.14159265358979323846;
+    double u0, u1;
+    CounterUniforms(seed, optimiserStream, sequence, pair, &u0, &u1);
+    double r = sqrt(-2 * log(1 - u0));
+    return k ? r * sin(2 * pi * u1) : r * cos(2 * pi * u1);
+}
+
+// Score the candidates' levers: tc from the batch kernel plus the mean damage against the surge
+// block (none when surges is NULL). With breachDraws every candidate draws its dike failures
+// from the same counters (ScoreSampledBreaches), otherwise block->breachMask is used, so
+// candidates always see common random numbers. A candidate with a NaN cost scores +inf.
+// Returns false, with the damage incomplete, when an arena is smaller than SurgeEvaluationBytes.
+bool ScorePopulation(int n, const double * W, const double * R, const double * P, const double * D, const double * B,
+                     const SurgeBlock * surges, const SurgeGenerator * breachDraws, uint64_t firstSequence,
+                     int numThreads, EvaluationArena * arenas, double * tcCol, double * damage, double * breaches) {
+    vector<int> caseCol(n);
+    vector<double> cols(13 * n);
+    CityColumns out = {caseCol.data(), cols.data(), cols.data() + n, cols.data() + 2*n, cols.data() + 3*n, tcCol,
+                       cols.data() + 5*n, cols.data() + 6*n, cols.data() + 7*n, cols.data() + 8*n, cols.data() + 9*n,
+                       cols.data() + 10*n, cols.data() + 11*n, cols.data() + 12*n};
+    CharacterizeCityBatchBranchFree(n, W, B, R, P, D, out);
+    for (int i = 0; i < n; i++) damage[i] = breaches[i] = 0;
+    if (!surges) return true;
+    std::atomic<bool> fits(true);
+    auto work = [&](int t) {
+        EvaluationArena * arena = &arenas[t];
+        for (int i = t; i < n; i += numThreads) {
+            ResetEvaluationArena(arena);
+            SurgeEvaluation eval;
+            if (!ArenaSurgeEvaluation(arena, surges, &eval)) {
+                fits = false;
+                return;
+            }
+            memset(eval.cityChar, 0, numCityChar * sizeof(double));
+            CharacterizeCity(W[i], B[i], R[i], P[i], D[i], eval.cityChar);
+            if (breachDraws) {
+                damage[i] = ScoreSampledBreaches(breachDraws, firstSequence, surges, &eval, &breaches[i]);
+            } else {
+                SimulateSurgeBlock(eval.cityChar, surges, eval.totals);
+                for (int s = 0; s < surges->numSequences; s++) {
+                    damage[i] += eval.totals.damage[s];
+                    breaches[i] += eval.totals.breachEvents[s];
+                }
+                damage[i] /= surges->numSequences;
+                breaches[i] /= (double)surges->numSequences * surges->numYears;
+            }
+        }
+    };
+    vector<std::thread> threads;
+    for (int t = 1; t < numThreads; t++) threads.emplace_back(work, t);
+    work(0);
+    for (auto& th : threads) th.join();
+    return fits;
+}
+
+// Minimize the total cost (tc plus mean damage, as in SweepStrategies) over the policy
+// fractions, evaluating each generation as one batch. The samples depend only on the seed and
+// the generation, so the result does not depend on the thread count. With a checkpointPath the
+// state is saved asynchronously by a CheckpointWriter; a run resumed from it ends as the
+// uninterrupted run does. If a generation cannot be scored the search stops with scored false.
+OptimiserResult OptimiseStrategy(const SurgeBlock * surges, const SurgeGenerator * breachDraws, uint64_t firstSequence,
+                                 const OptimiserOptions& options) {
+    const int n = numPolicyFractions;
+    int lambda = options.populationSize > 0 ? options.populationSize : 4 + (int)(3 * log((double)n));
+    int mu = lambda / 2;
+    vector<double> weights(mu);
+    double sumW = 0, sumW2 = 0;
+    for (int i = 0; i < mu; i++) { weights[i] = log(mu + 0.5) - log(i + 1.0); sumW += weights[i]; }
+    for (int i = 0; i < mu; i++) { weights[i] /= sumW; sumW2 += weights[i] * weights[i]; }
+    double muEff = 1 / sumW2;
+    double cSigma = (muEff + 2) / (n + muEff + 5);
+    double dSigma = 1 + 2 * std::max(0.0, sqrt((muEff - 1) / (n + 1)) - 1) + cSigma;
+    double cc = (4 + muEff / n) / (n + 4 + 2 * muEff / n);
+    double c1 = 2 / ((n + 1.3) * (n + 1.3) + muEff);
+    double cMu = std::min(1 - c1, 2 * (muEff - 2 + 1 / muEff) / ((n + 2) * (n + 2) + muEff));
+    c1 *= (n + 2) / 3.0;                 // separable learning rates
+    cMu = std::min(1 - c1, cMu * (n + 2) / 3.0);
+    double chiN = sqrt((double)n) * (1 - 1.0 / (4 * n) + 1.0 / (21 * n * n));
+
+    double mean[n], diagC[n], pSigma[n], pc[n];
+    for (int j = 0; j < n; j++) { mean[j] = 0.5; diagC[j] = 1; pSigma[j] = 0; pc[j] = 0; }
+    double sigma = options.initialSigma;
+    int g = 0;
+    bool converged = false;
+    OptimiserResult result = {};
+    result.best.totalCost = INFINITY;
+    result.best.index = -1;
+    result.evaluations = 0;
+    if (options.resume) {
+        const OptimiserState& s = *options.resume;
+        for (int j = 0; j < n; j++) {
+            mean[j] = s.mean[j]; diagC[j] = s.diagC[j]; pSigma[j] = s.pSigma[j]; pc[j] = s.pc[j];
+            result.fractions[j] = s.fractions[j];
+        }
+        sigma = s.sigma;
+        g = s.generation;
+        converged = s.converged;
+        result.best = s.best;
+        result.evaluations = s.evaluations;
+    }
+    CheckpointWriter writer;
+    if (options.checkpointPath) StartCheckpointWriter(&writer, options.checkpointPath);
+    auto saveState = [&]() {
+        OptimiserState s;
+        for (int j = 0; j < n; j++) {
+            s.mean[j] = mean[j]; s.diagC[j] = diagC[j]; s.pSigma[j] = pSigma[j]; s.pc[j] = pc[j];
+            s.fractions[j] = result.fractions[j];
+        }
+        s.sigma = sigma;
+        s.generation = g;
+        s.converged = converged;
+        s.best = result.best;
+        s.evaluations = result.evaluations;
+        uint64_t seed = options.seed;
+        SubmitCheckpoint(&writer, [=](CheckpointData * data) {
+            AddOptimiserState(data, lambda, seed, surges, breachDraws, firstSequence, s);
+            return true;
+        });
+    };
+
+    int numThreads = options.numThreads > 0 ? options.numThreads : std::max(1u, std::thread::hardware_concurrency());
+    numThreads = std::min(numThreads, lambda);
+    std::unique_ptr<EvaluationArena[]> arenas(new EvaluationArena[numThreads]);
+    for (int t = 0; t < numThreads; t++)
+        if (!InitEvaluationArena(&arenas[t], surges ? SurgeEvaluationBytes(surges) : 0)) throw std::bad_alloc();
+
+    vector<double> z(lambda * n), x(lambda * n), repaired(lambda * n), excess(lambda), ranked(lambda);
+    vector<double> W(lambda), R(lambda), P(lambda), D(lambda), B(lambda), tcCol(lambda), damage(lambda), breaches(lambda);
+    vector<int> order(lambda);
+    while (!converged && g < options.maxGenerations) {
+        for (int k = 0; k < lambda; k++) {
+            for (int j = 0; j < n; j++) {
+                z[k * n + j] = OptimiserNormal(options.seed, (uint64_t)g * lambda + k, j / 2, j % 2);
+                x[k * n + j] = mean[j] + sigma * sqrt(diagC[j]) * z[k * n + j];
+            }
+            // evaluate the nearest point of the cube, penalizing the distance to it in the ranking
+            double * r = &repaired[k * n];
+            excess[k] = 0;
+            for (int j = 0; j < n; j++) {
+                r[j] = std::min(1.0, std::max(0.0, x[k * n + j]));
+                excess[k] += (x[k * n + j] - r[j]) * (x[k * n + j] - r[j]);
+            }
+            PolicyLevers(r, W[k], R[k], P[k], D[k], B[k]);
+        }
+        // the arenas were sized by SurgeEvaluationBytes, so this only fails if that undercounts
+        if (!ScorePopulation(lambda, W.data(), R.data(), P.data(), D.data(), B.data(), surges, breachDraws, firstSequence,
+                             numThreads, arenas.get(), tcCol.data(), damage.data(), breaches.data())) {
+            cerr << "A surge evaluation does not fit SurgeEvaluationBytes\n";
+            result.scored = false;
+            break;
+        }
+        for (int k = 0; k < lambda; k++) {
+            double total = tcCol[k] + damage[k];
+            SweepCandidate c = {result.evaluations++, W[k], R[k], P[k], D[k], B[k], NAN, damage[k], breaches[k], total,
+                                surges ? surges->numSequences : 0};
+            if (SweepBetter(c, result.best)) {
+                result.best = c;
+                for (int j = 0; j < n; j++) result.fractions[j] = repaired[k * n + j];
+            }
+            ranked[k] = (total == total) ? total + (fabs(total) + 1) * excess[k] : INFINITY;
+        }
+        for (int k = 0; k < lambda; k++) order[k] = k;
+        std::sort(order.begin(), order.end(), [&](int a, int b) { return ranked[a] < ranked[b] || (ranked[a] == ranked[b] && a < b); });
+
+        // recombination and evolution paths
+        double zMean[n], yMean[n], norm = 0;
+        for (int j = 0; j < n; j++) {
+            zMean[j] = yMean[j] = 0;
+            for (int i = 0; i < mu; i++) {
+                zMean[j] += weights[i] * z[order[i] * n + j];
+                yMean[j] += weights[i] * sqrt(diagC[j]) * z[order[i] * n + j];
+            }
+            mean[j] += sigma * yMean[j];
+            pSigma[j] = (1 - cSigma) * pSigma[j] + sqrt(cSigma * (2 - cSigma) * muEff) * zMean[j];
+            norm += pSigma[j] * pSigma[j];
+        }
+        norm = sqrt(norm);
+        bool hSigma = norm / sqrt(1 - pow(1 - cSigma, 2.0 * (g + 1))) < (1.4 + 2.0 / (n + 1)) * chiN;
+        double largestAxis = 0;
+        for (int j = 0; j < n; j++) {
+            pc[j] = (1 - cc) * pc[j] + (hSigma ? sqrt(cc * (2 - cc) * muEff) * yMean[j] : 0);
+            double rankMu = 0;
+            for (int i = 0; i < mu; i++) rankMu += weights[i] * diagC[j] * z[order[i] * n + j] * z[order[i] * n + j];
+            diagC[j] = (1 - c1 - cMu) * diagC[j] + c1 * (pc[j] * pc[j] + (hSigma ? 0 : cc * (2 - cc) * diagC[j])) + cMu * rankMu;
+            largestAxis = std::max(largestAxis, sqrt(diagC[j]));
+        }
+        sigma *= exp((cSigma / dSigma) * (norm / chiN - 1));
+        converged = sigma * largestAxis < options.minSigma;
+        g++;
+        if (options.checkpointPath && options.checkpointEvery > 0 && g % options.checkpointEvery == 0) saveState();
+    }
+    for (int t = 0; t < numThreads; t++) FreeEvaluationArena(&arenas[t]);
+    if (options.checkpointPath) {
+        saveState();
+        result.checkpointed = StopCheckpointWriter(&writer);
+    }
+    // tic of the best, which the batch above only kept as part of tc
+    if (result.best.index >= 0) {
+        double cityChar[numCityChar];
+        memset(cityChar, 0, sizeof(cityChar));
+        CharacterizeCity(result.best.W, result.best.B, result.best.R, result.best.P, result.best.D, cityChar);
+        result.best.tic = cityChar[tic];
+    }
+    result.generations = g;
+    return result;
+}
+
+
+// ========================================
+// SENSITIVITIES
+// ========================================
+
+// Forward-mode dual number: a value and its partial derivatives with respect to N inputs.
+// The value is computed by exactly the same operations as with double, so it is bit-identical.
+template <int N>
+struct Dual {
+    double v;
+    double d[N];
+
+    Dual(double x = 0) : v(x) { for (int k = 0; k < N; k++) d[k] = 0; }
+
+    friend Dual operator-(const Dual& a) {
+        Dual r(-a.v);
+        for (int k = 0; k < N; k++) r.d[k] = -a.d[k];
+        return r;
+    }
+    friend Dual operator+(const Dual& a, const Dual& b) {
+        Dual r(a.v + b.v);
+        for (int k = 0; k < N; k++) r.d[k] = a.d[k] + b.d[k];
+        return r;
+    }
+    friend Dual operator-(const Dual& a, const Dual& b) {
+        Dual r(a.v - b.v);
+        for (int k = 0; k < N; k++) r.d[k] = a.d[k] - b.d[k];
+        return r;
+    }
+    friend Dual operator*(const Dual& a, const Dual& b) {
+        Dual r(a.v * b.v);
+        for (int k = 0; k < N; k++) r.d[k] = a.d[k] * b.v + a.v * b.d[k];
+        return r;
+    }
+    friend Dual operator/(const Dual& a, const Dual& b) {
+        Dual r(a.v / b.v);
+        for (int k = 0; k < N; k++) r.d[k] = (a.d[k] - r.v * b.d[k]) / b.v;
+        return r;
+    }
+    friend Dual pow(const Dual& a, double n) {
+        Dual r(pow(a.v, n));
+        double slope = n * pow(a.v, n - 1);
+        for (int k = 0; k < N; k++) r.d[k] = slope * a.d[k];
+        return r;
+    }
+    // sqrt(0) is reached from T<0, where the dike cost uses 0, so its slope is taken as 0
+    friend Dual sqrt(const Dual& a) {
+        Dual r(sqrt(a.v));
+        for (int k = 0; k < N; k++) r.d[k] = (a.v > 0) ? a.d[k] / (2 * r.v) : 0.0;
+        return r;
+    }
+    friend double ValueOf(const Dual& a) { return a.v; }
+};
+
+inline double ValueOf(double x) { return x; }
+
+// std::max(a, b) for any scalar: the branch CharacterizeCity takes also supplies the derivative
+template <class T>
+T MaxOf(const T& a, const T& b) { return (ValueOf(a) < ValueOf(b)) ? b : a; }
+
+// CalculateDikeCostPrepared on any scalar type
+template <class T>
+T DikeCostScalar(const T& hd, const DikeCostParams * p) {
+    using std::pow;
+    using std::sqrt;
+    T ch = hd + p->ich;
+    T ch2 = pow(ch, 2);
+    T ch3 = pow(ch, 3);
+    T ch4 = pow(ch, 4);
+    T ch5 = pow(ch, 5);
+    T ch6 = pow(ch, 6);
+    T chs = ch + p->invSd;
+    T t = -ch4*pow(chs,2)/p->sd2-
+          2*(ch5*chs)/p->S4-
+          4*ch6/p->sd2S4+
+          4*ch4*(2*ch*chs-3*ch2/p->sd2)/p->sd2S2+
+          2*ch3*chs/p->S2;
+    T sqrt_T = (ValueOf(t) >= 0) ? sqrt(t) : T(0.0);
+    T vd = p->W*ch*(p->wdt+ch/p->sd2)+
+           sqrt_T/6+
+           p->wdt*(ch2/p->S2);
+    return vd*p->cd;
+}
+
+// cost terms of CharacterizeCity
+template <class T>
+struct CityCostTerms {
+    T wc, dc, rc, fcv, tic, tc;
+    int caseNum;
+};
+
+// The cost path of CharacterizeCity on any scalar type. Case and lever rules are decided on values,
+// so the derivatives are those of the case CharacterizeCity selects: on a case boundary (R==B, or a
+// lever at 0) they are one-sided from that case, and levers replaced by 0 or a default (baseValue,
+// below minHeight, dike too close to the withdrawal) contribute nothing.
+template <class T>
+CityCostTerms<T> CityCostsScalar(const T& W, const T& B, const T& R, const T& P, const T& D) {
+    const T zero(0.0);
+    T whv = (ValueOf(W)==baseValue) ? zero : W;
+    bool noR = (ValueOf(R)==baseValue || ValueOf(R)<minHeight);
+    T rhv = noR ? zero : R;
+    T rpv = noR ? T(0.5) : P;
+    T dhv = (ValueOf(D)==baseValue) ? zero : D;
+    T dbhv = (ValueOf(B)<minHeight || ValueOf(B)==baseValue) ? zero : B;
+    if ((ValueOf(dhv)>=minHeight) && (ValueOf(dbhv)<minHeight) && (ValueOf(rhv)>=minHeight)) {
+        dbhv = zero;
+        rhv = zero;
+    }
+    bool hasD = ValueOf(dhv)>0, hasB = ValueOf(dbhv)>0, hasR = ValueOf(rhv)>0, rBelowB = ValueOf(rhv)<ValueOf(dbhv);
+    int c;
+    if (hasD) c = hasB ? (hasR ? (rBelowB ? 1 : 2) : 3) : 4;
+    else c = hasB ? (hasR ? (rBelowB ? 5 : 6) : 7) : (hasR ? 8 : 9);
+
+    CityCostTerms<T> out;
+    out.caseNum = c;
+    T remaining = CEC - whv;
+    out.wc = (ValueOf(whv)==0) ? zero : TotalCityValueInitial*whv/remaining*WithdrawelCostFactor;
+    T tcvawv = TotalCityValueInitial*(1.0 - WithdrawelPercentLost*whv/CEC);
+    T unprotected = tcvawv*DikeUnprotectedValuationRatio;
+    T fcR = resistanceAdjustment*(resistanceExponentialFactor*MaxOf(T(0.0),(rpv-resistanceExponentialThreshold))/(1.0-rpv) +
+            rpv*resistanceLinearFactor);
+    T resiliencyBase = BH*remaining;
+    out.dc = (c<=5 || c==7) ? DikeCostScalar(dhv, &cityDikeCost) : zero;
+    T protD = tcvawv*ProtectedValueRatio*dhv/remaining;
+    switch (c) {
+        case 1:
+            out.fcv = unprotected*rhv/remaining + unprotected*(dbhv-rhv)/remaining + protD + tcvawv*(remaining-dbhv-dhv)/remaining;
+            out.rc = tcvawv*fcR*rhv*(rhv/2 + Basement)/resiliencyBase;
+            break;
+        case 2:
+            out.fcv = zero + protD + tcvawv*(remaining-dbhv-dhv)/remaining;
+            out.rc = tcvawv*fcR*dbhv*(rhv - dbhv/2 + Basement)/resiliencyBase;
+            break;
+        case 3:
+            out.fcv = unprotected*dbhv/remaining + protD + tcvawv*(remaining-dbhv-dhv)/remaining;
+            out.rc = zero;
+            break;
+        case 4:
+            out.fcv = protD + tcvawv*(remaining-dhv)/remaining;
+            out.rc = zero;
+            break;
+        case 5:
+            out.fcv = unprotected*rhv/remaining + unprotected*(dbhv-rhv)/remaining + tcvawv*(remaining-dbhv)/remaining;
+            out.rc = tcvawv*fcR*rhv*(rhv/2 + Basement)/resiliencyBase;
+            break;
+        case 6:
+            out.fcv = unprotected*dbhv/remaining + tcvawv*(remaining-dbhv)/remaining;
+            out.rc = tcvawv*fcR*dbhv*(rhv - dbhv/2 + Basement)/resiliencyBase;
+            break;
+        case 7:
+            out.fcv = unprotected*dbhv/remaining + tcvawv*(remaining-dbhv)/remaining;
+            out.rc = zero;
+            break;
+        case 8:
+            out.fcv = tcvawv*rhv/remaining + tcvawv*(remaining-rhv)/remaining;
+            out.rc = tcvawv*fcR*rhv*(rhv/2 + Basement)/resiliencyBase;
+            break;
+        default:
+            out.fcv = tcvawv;
+            out.rc = zero;
+            break;
+    }
+    out.tic = out.wc+out.dc+out.rc;
+    out.tc = (c==9) ? TotalCityValueInitial-out.fcv : out.tic+out.fcv-TotalCityValueInitial;
+    return out;
+}
+
+// partial derivative slots of CityGradient
+const int gradW = 0;
+const int gradR = 1;
+const int gradP = 2;
+const int gradD = 3;
+const int gradB = 4;
+const int numGradients = 5;
+
+extern "C" {
+
+    // tic and tc of CharacterizeCity with their partial derivatives with respect to the levers
+    struct CityGradient {
+        int caseNum;
+        double tic, tc;
+        double dtic[numGradients], dtc[numGradients];
+    };
+
+    // One forward-mode pass instead of a value and five finite differences. tic and tc are
+    // bit-identical to CharacterizeCity; see CityCostsScalar for the derivatives at case boundaries.
+    void CharacterizeCityGradient(double W,double B,double R,double P,double D,CityGradient * out) {
+        typedef Dual<numGradients> Scalar;
+        Scalar w(W), b(B), r(R), p(P), d(D);
+        w.d[gradW] = 1; r.d[gradR] = 1; p.d[gradP] = 1; d.d[gradD] = 1; b.d[gradB] = 1;
+        CityCostTerms<Scalar> terms = CityCostsScalar(w, b, r, p, d);
+        out->caseNum = terms.caseNum;
+        out->tic = terms.tic.v;
+        out->tc = terms.tc.v;
+        for (int k = 0; k < numGradients; k++) {
+            out->dtic[k] = terms.tic.d[k];
+            out->dtc[k] = terms.tc.d[k];
+        }
+    }
+
+} // extern "C"
+
+
+// ========================================
+// C ABI
+// ========================================
+
+// The libicow entry points declared in icow.h, thin wrappers over the batched kernels above.
+// The kernels take an int count, so longer batches are run in pieces of abiPiece strategies.
+const int64_t abiPiece = (int64_t)1 << 30;
+
+extern "C" {
+
+    int IcowAbiVersion(void) {
+        return ICOW_ABI_VERSION;
+    }
+
+    void IcowCharacterize(int64_t n, const double * W, const double * B, const double * R,
+                          const double * P, const double * D, double * cityChars) {
+        for (int64_t i = 0; i < n; i++) {
+            double * cityChar = cityChars + i * numCityChar;
+            memset(cityChar, 0, numCityChar * sizeof(double));
+            CharacterizeCity(W[i], B[i], R[i], P[i], D[i], cityChar);
+        }
+    }
+
+    void IcowCharacterizeColumns(int64_t n, const double * W, const double * B, const double * R,
+                                 const double * P, const double * D, int * caseNum, double * columns) {
+        for (int64_t i = 0; i < n; i += abiPiece) {
+            int m = (int)std::min(abiPiece, n - i);
+            double * c = columns + i;
+            CityColumns out = {caseNum + i, c, c + n, c + 2*n, c + 3*n, c + 4*n, c + 5*n, c + 6*n,
+                               c + 7*n, c + 8*n, c + 9*n, c + 10*n, c + 11*n, c + 12*n};
+            CharacterizeCityBatchBranchFree(m, W + i, B + i, R + i, P + i, D + i, out);
+        }
+    }
+
+    void IcowCharacterizeColumnsFloat(int64_t n, const float * W, const float * B, const float * R,
+                                      const float * P, const float * D, int * caseNum, float * columns) {
+        for (int64_t i = 0; i < n; i += abiPiece) {
+            int m = (int)std::min(abiPiece, n - i);
+            float * c = columns + i;
+            CityColumnsFloat out = {caseNum + i, c, c + n, c + 2*n, c + 3*n, c + 4*n, c + 5*n, c + 6*n,
+                                    c + 7*n, c + 8*n, c + 9*n, c + 10*n, c + 11*n, c + 12*n};
+            CharacterizeCityBatchFloat(m, W + i, B + i, R + i, P + i, D + i, out);
+        }
+    }
+
+    void IcowCharacterizeGradient(int64_t n, const double * W, const double * B, const double * R,
+                                  const double * P, const double * D, int * caseNum, double * tic,
+                                  double * tc, double * dtic, double * dtc) {
+        static_assert(ICOW_NUM_GRADIENTS == numGradients && gradW == 0 && gradR == 1 && gradP == 2 &&
+                      gradD == 3 && gradB == 4, "icow.h orders the gradients W, R, P, D, B");
+        for (int64_t i = 0; i < n; i++) {
+            CityGradient g;
+            CharacterizeCityGradient(W[i], B[i], R[i], P[i], D[i], &g);
+            caseNum[i] = g.caseNum;
+            tic[i] = g.tic;
+            tc[i] = g.tc;
+            for (int k = 0; k < numGradients; k++) {
+                dtic[k * n + i] = g.dtic[k];
+                dtc[k * n + i] = g.dtc[k];
+            }
+        }
+    }
+
+    void IcowDamage(const double * cityChar, int64_t n, const double * surge,
+                    const uint64_t * breachMask, double * damage) {
+        if (n <= abiPiece) {
+            CalculateDamageBlock(cityChar, (int)n, surge, breachMask, damage);
+            return;
+        }
+        // the block kernel writes its dvLength columns m apart, so long batches go through a tile
+        double tile[dvLength * surgeTile];
+        for (int64_t i = 0; i < n; i += surgeTile) {
+            int m = (int)std::min<int64_t>(surgeTile, n - i);
+            CalculateDamageBlock(cityChar, m, surge + i, breachMask ? breachMask + i / 64 : NULL, tile);
+            for (int k = 0; k < dvLength; k++) memcpy(damage + k * n + i, tile + k * m, m * sizeof(double));
+        }
+    }
+
+    void IcowExpectedAnnualDamage(int64_t n, const double * cityChars, double loc, double scale,
+                                  double shape, double rtol, double * ead) {
+        SurgeGenerator gev = {0, loc, scale, shape};
+        EadZoneCache cache = MakeEadZoneCache(gev, rtol);
+        for (int64_t i = 0; i < n; i++) ead[i] = ExpectedAnnualDamage(cityChars + i * numCityChar, &cache);
+    }
+
+    void IcowScoreSurgeBlock(int64_t n, const double * cityChars, const double * surge,
+                             const uint64_t * breachMask, int numSequences, int numYears, int layout,
+                             double * damage, int * floodEvents, int * breachEvents, int * thresholdEvents) {
+        SurgeBlock block = {surge, breachMask, numSequences, numYears, layout};
+        for (int64_t i = 0; i < n; i++) {
+            size_t offset = (size_t)i * numSequences;
+            SequenceDamage out = {damage + offset, floodEvents + offset, breachEvents + offset, thresholdEvents + offset};
+            SimulateSurgeBlock(cityChars + i * numCityChar, &block, out);
+        }
+    }
+
+} // extern "C"
+
+
+// ========================================
+// TEST HARNESS - Generate reference outputs
+// ========================================
+
+using namespace std;
+
+struct TestCase {
+    string name;
+    double W, R, P, D, B;  // Levers
+    double h_surge;         // Surge height for damage calculation
+};
+
+// The 8 test cases behind outputs/*.txt, covering edge cases and typical scenarios; every
+// harness that checks against the reference outputs takes them from here
+vector<TestCase> ReferenceTestCases() {
+    return {
+        {"zero_case", 0, 0, 0, 0, 0, 0},
+        {"dike_only", 0, 0, 0, 5, 0, 3},
+        {"full_protection", 2, 3, 0.8, 5, 1, 4},
+        {"resistance_only", 0, 4, 0.5, 0, 0, 2},
+        {"withdrawal_only", 5, 0, 0, 0, 0, 3},
+        {"edge_r_geq_b", 0, 6, 0.5, 3, 5, 4},
+        {"high_surge", 2, 3, 0.8, 5, 1, 15},
+        {"below_seawall", 0, 0, 0, 0, 0, 1.5}
+    };
+}
+
+typedef void (*BatchFunction)(int, const double *, const double *, const double *, const double *, const double *, CityColumns);
+
+// Lever columns for checking the batched paths: the test cases plus a small grid that reaches
+// all 9 cases, the minHeight cutoffs and the baseValue sentinel
+struct LeverColumns {
+    vector<double> W, B, R, P, D;
+};
+
+LeverColumns ConsistencyLevers(const vector<TestCase>& test_cases) {
+    LeverColumns lv;
+    for (const auto& tc : test_cases) {
+        lv.W.push_back(tc.W); lv.B.push_back(tc.B); lv.R.push_back(tc.R); lv.P.push_back(tc.P); lv.D.push_back(tc.D);
+    }
+    const double Ws[] = {0, 2, baseValue};
+    const double Rs[] = {0, 0.05, 3, 6, baseValue};
+    const double Ps[] = {0, 0.5, 0.8};
+    const double Ds[] = {0, 0.05, 3, 5, baseValue};
+    const double Bs[] = {0, 0.05, 1, 5, baseValue};
+    for (double W : Ws) for (double R : Rs) for (double P : Ps) for (double D : Ds) for (double B : Bs) {
+        lv.W.push_back(W); lv.B.push_back(B); lv.R.push_back(R); lv.P.push_back(P); lv.D.push_back(D);
+    }
+    return lv;
+}
+
+// Levers drawn uniformly from the fixed seed: W, R, B and D in [0, CEC/2), P in [0, 0.99)
+const uint32_t leverStream=2;
+
+LeverColumns RandomLevers(int n, uint64_t seed) {
+    LeverColumns lv;
+    for (int i = 0; i < n; i++) {
+        double u[6];
+        CounterUniforms(seed, leverStream, i, 0, &u[0], &u[1]);
+        CounterUniforms(seed, leverStream, i, 1, &u[2], &u[3]);
+        CounterUniforms(seed, leverStream, i, 2, &u[4], &u[5]);
+        lv.W.push_back(u[0] * CEC / 2); lv.R.push_back(u[1] * CEC / 2); lv.P.push_back(u[2] * 0.99);
+        lv.D.push_back(u[3] * CEC / 2); lv.B.push_back(u[4] * CEC / 2);
+    }
+    return lv;
+}
+
+// Accuracy of CharacterizeCityBatchFloat against the double batch on the same levers (rounded to
+// float): the largest relative error of each column, over strategies whose case and double
+// result agree and are finite. A column that is 0 in double must be 0 in float.
+struct FloatErrorReport {
+    static const int numColumns = 13;
+    double maxRelError[numColumns];   // wc, rc, dc, tic, tc, vz1..vz4, tz1..tz4
+    int64_t strategies;
+    int64_t caseMismatches;           // lever rounding moved the strategy to another case
+};
+
+const char * const floatReportColumns[FloatErrorReport::numColumns] =
+    {"wc", "rc", "dc", "tic", "tc", "vz1", "vz2", "vz3", "vz4", "tz1", "tz2", "tz3", "tz4"};
+
+FloatErrorReport FloatModeError(const LeverColumns& lv) {
+    int n = lv.W.size();
+    vector<float> f[5];
+    const vector<double> * in[5] = {&lv.W, &lv.B, &lv.R, &lv.P, &lv.D};
+    for (int k = 0; k < 5; k++) f[k].assign(in[k]->begin(), in[k]->end());
+    vector<int> caseD(n), caseF(n);
+    vector<vector<double>> colD(13, vector<double>(n));
+    vector<vector<float>> colF(13, vector<float>(n));
+    CityColumns d = {caseD.data(), colD[0].data(), colD[1].data(), colD[2].data(), colD[3].data(), colD[4].data(),
+                     colD[5].data(), colD[6].data(), colD[7].data(), colD[8].data(), colD[9].data(), colD[10].data(),
+                     colD[11].data(), colD[12].data()};
+    CityColumnsFloat s = {caseF.data(), colF[0].data(), colF[1].data(), colF[2].data(), colF[3].data(), colF[4].data(),
+                          colF[5].data(), colF[6].data(), colF[7].data(), colF[8].data(), colF[9].data(), colF[10].data(),
+                          colF[11].data(), colF[12].data()};
+    CharacterizeCityBatchBranchFree(n, lv.W.data(), lv.B.data(), lv.R.data(), lv.P.data(), lv.D.data(), d);
+    CharacterizeCityBatchFloat(n, f[0].data(), f[1].data(), f[2].data(), f[3].data(), f[4].data(), s);
+
+    FloatErrorReport report;
+    for (int k = 0; k < FloatErrorReport::numColumns; k++) report.maxRelError[k] = 0;
+    report.strategies = 0;
+    report.caseMismatches = 0;
+    for (int i = 0; i < n; i++) {
+        if (caseD[i] != caseF[i]) { report.caseMismatches++; continue; }
+        bool finite = true;
+        for (int k = 0; k < 13; k++) finite = finite && fabs(colD[k][i]) <= std::numeric_limits<double>::max();
+        if (!finite) continue;
+        report.strategies++;
+        for (int k = 0; k < 13; k++) {
+            double exact = colD[k][i], approx = colF[k][i];
+            double err = (exact == 0) ? ((approx == 0) ? 0 : INFINITY) : fabs(approx - exact) / fabs(exact);
+            report.maxRelError[k] = std::max(report.maxRelError[k], err);
+        }
+    }
+    return report;
+}
+
+// Float mode must stay within a few float ulps on the test cases, and the investment costs within
+// 1e-5 on the random sample; tc and the zone values above a thin remaining band cancel and are
+// only reported
+bool FloatModeAccurate(const vector<TestCase>& test_cases) {
+    LeverColumns cases;
+    for (const auto& tc : test_cases) {
+        cases.W.push_back(tc.W); cases.B.push_back(tc.B); cases.R.push_back(tc.R); cases.P.push_back(tc.P); cases.D.push_back(tc.D);
+    }
+    FloatErrorReport fixed = FloatModeError(cases), random = FloatModeError(RandomLevers(4096, 20250101));
+    bool ok = fixed.caseMismatches == 0 && fixed.strategies == (int64_t)test_cases.size();
+    for (int k = 0; k < FloatErrorReport::numColumns; k++) ok = ok && fixed.maxRelError[k] < 1e-6;
+    for (int k = 0; k < 4; k++) ok = ok && random.maxRelError[k] < 1e-5;   // wc, rc, dc, tic
+    if (!ok) cerr << "Float mode exceeds its error bounds (see --float-error)\n";
+    return ok;
+}
+
+// --float-error [samples]: float mode accuracy on the test cases and on a random lever sample
+int RunFloatError(int argc, char ** argv, const vector<TestCase>& test_cases) {
+    int samples = (argc > 2) ? atoi(argv[2]) : 100000;
+    LeverColumns cases;
+    for (const auto& tc : test_cases) {
+        cases.W.push_back(tc.W); cases.B.push_back(tc.B); cases.R.push_back(tc.R); cases.P.push_back(tc.P); cases.D.push_back(tc.D);
+    }
+    FloatErrorReport fixed = FloatModeError(cases), random = FloatModeError(RandomLevers(samples, 20250101));
+    cout << std::setprecision(3);
+    cout << "# max relative error of float mode against double\n";
+    cout << "column  test_cases  random\n";
+    for (int k = 0; k < FloatErrorReport::numColumns; k++)
+        cout << floatReportColumns[k] << "  " << fixed.maxRelError[k] << "  " << random.maxRelError[k] << "\n";
+    cout << "strategies  " << fixed.strategies << "  " << random.strategies << "\n";
+    cout << "case_mismatches  " << fixed.caseMismatches << "  " << random.caseMismatches << "\n";
+    return 0;
+}
+
+// Run a batched CharacterizeCity over the levers and compare every column with the scalar call
+bool BatchMatchesScalar(BatchFunction batch, const LeverColumns& lv) {
+    int n = lv.W.size();
+    const vector<double>& W = lv.W;
+    const vector<double>& B = lv.B;
+    const vector<double>& R = lv.R;
+    const vector<double>& P = lv.P;
+    const vector<double>& D = lv.D;
+    vector<int> caseCol(n);
+    vector<vector<double>> col(13, vector<double>(n));
+    CityColumns cols = {caseCol.data(), col[0].data(), col[1].data(), col[2].data(), col[3].data(),
+                        col[4].data(), col[5].data(), col[6].data(), col[7].data(), col[8].data(),
+                        col[9].data(), col[10].data(), col[11].data(), col[12].data()};
+    batch(n, W.data(), B.data(), R.data(), P.data(), D.data(), cols);
+    const int colIndex[13] = {wc, rc, dc, tic, tc, vz1, vz2, vz3, vz4, tz1, tz2, tz3, tz4};
+    for (int i = 0; i < n; i++) {
+        double cityChar[27];
+        memset(cityChar, 0, sizeof(cityChar));
+        CharacterizeCity(W[i], B[i], R[i], P[i], D[i], cityChar);
+        bool match = (caseCol[i] == (int)cityChar[caseNum]);
+        for (int k = 0; k < 13; k++) match = match && (col[k][i] == cityChar[colIndex[k]]);
+        if (!match) {
+            cerr << "Batched CharacterizeCity does not match scalar for W=" << W[i] << ", R=" << R[i]
+                 << ", P=" << P[i] << ", D=" << D[i] << ", B=" << B[i] << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+// the runtime-parameter path with the default city, for BatchMatchesScalar
+void CharacterizeCityBatchDefaultRuntimeCity(int n, const double * W, const double * B, const double * R, const double * P, const double * D, CityColumns out) {
+    CityParams city = DeriveCityParams(CityParams());
+    DikeCostParams dike = PrepareCityDikeCost(city);
+    CharacterizeCityBatchForCity(&city, &dike, NULL, n, W, B, R, P, D, out);
+}
+
+// the cached dike cost path, for BatchMatchesScalar; the cache persists across calls
+void CharacterizeCityBatchCachedDikeCost(int n, const double * W, const double * B, const double * R, const double * P, const double * D, CityColumns out) {
+    static DikeCostCache cache;
+    static bool initialized = false;
+    if (!initialized) { InitDikeCostCache(&cityDikeCost, &cache); initialized = true; }
+    CharacterizeCityBatchWithDikeCache(n, W, B, R, P, D, out, &cache);
+}
+
+// CharacterizeCityStaged must fill every cityChar entry exactly as CharacterizeCity does, with and
+// without the dike cost cache and fcR table; W is prepared only when it changes, as a sweep would
+bool StagedMatchesScalar(const LeverColumns& lv) {
+    DikeCostCache cache;
+    InitDikeCostCache(&cityDikeCost, &cache);
+    ResistanceFractionTable fractions;
+    BuildResistanceFractionTable((int)lv.P.size(), lv.P.data(), &fractions);
+    WithdrawalStage stage;
+    for (size_t i = 0; i < lv.W.size(); i++) {
+        if (i == 0 || lv.W[i] != lv.W[i - 1]) PrepareWithdrawal(lv.W[i], &stage);
+        double expected[numCityChar], staged[numCityChar], cached[numCityChar];
+        memset(expected, 0, sizeof(expected));
+        memset(staged, 0, sizeof(staged));
+        memset(cached, 0, sizeof(cached));
+        CharacterizeCity(lv.W[i], lv.B[i], lv.R[i], lv.P[i], lv.D[i], expected);
+        CharacterizeCityStaged(&stage, NULL, NULL, lv.B[i], lv.R[i], lv.P[i], lv.D[i], staged);
+        CharacterizeCityStaged(&stage, &cache, &fractions, lv.B[i], lv.R[i], lv.P[i], lv.D[i], cached);
+        for (int k = 0; k < numCityChar; k++) {
+            if (staged[k] != expected[k] || cached[k] != expected[k]) {
+                cerr << "Staged CharacterizeCity does not match scalar for W=" << lv.W[i] << ", R=" << lv.R[i]
+                     << ", P=" << lv.P[i] << ", D=" << lv.D[i] << ", B=" << lv.B[i] << " (entry " << k << ")\n";
+                return false;
+            }
+        }
+    }
+    if (cache.hits == 0) {
+        cerr << "Dike cost cache never hit\n";
+        return false;
+    }
+    return true;
+}
+
+// ResistanceCostFraction, fast path included, and its table must reproduce the original fcR expression
+bool ResistanceFractionMatches() {
+    vector<double> P;
+    for (int k = 0; k < 1000; k++) P.push_back(k / 1000.0);
+    P.push_back(resistanceExponentialThreshold);
+    ResistanceFractionTable table;
+    BuildResistanceFractionTable(21, P.data() + 500, &table);   // 0.5 .. 0.52, like a P axis
+    for (double rp : P) {
+        double expected = resistanceAdjustment*(resistanceExponentialFactor*std::max(0.0,(rp-resistanceExponentialThreshold))/(1.0-rp) +
+                          rp*resistanceLinearFactor);
+        if (ResistanceCostFraction(rp) != expected || ResistanceFractionLookup(&table, rp) != expected) {
+            cerr << "Resistance cost fraction does not match at rp=" << rp << "\n";
+            return false;
+        }
+    }
+    return table.count == 21;
+}
+
+// CharacterizeCityGradient must reproduce tic and tc exactly, and its derivatives must match central
+// differences of CharacterizeCity wherever the step stays inside one case and away from the kinks
+bool GradientMatchesFiniteDifferences(const LeverColumns& lv) {
+    int checked = 0;
+    for (size_t i = 0; i < lv.W.size(); i++) {
+        double x[numGradients];
+        x[gradW] = lv.W[i]; x[gradR] = lv.R[i]; x[gradP] = lv.P[i]; x[gradD] = lv.D[i]; x[gradB] = lv.B[i];
+        CityGradient g;
+        CharacterizeCityGradient(x[gradW], x[gradB], x[gradR], x[gradP], x[gradD], &g);
+        double cityChar[numCityChar];
+        memset(cityChar, 0, sizeof(cityChar));
+        CharacterizeCity(x[gradW], x[gradB], x[gradR], x[gradP], x[gradD], cityChar);
+        if (g.caseNum != (int)cityChar[caseNum] || g.tic != cityChar[tic] || g.tc != cityChar[tc]) {
+            cerr << "CharacterizeCityGradient value does not match scalar for W=" << x[gradW] << ", R=" << x[gradR]
+                 << ", P=" << x[gradP] << ", D=" << x[gradD] << ", B=" << x[gradB] << "\n";
+            return false;
+        }
+        for (int k = 0; k < numGradients; k++) {
+            double h = 1e-6 * std::max(1.0, fabs(x[k]));
+            if (x[k] == 0 || x[k] == baseValue || (k == gradP && fabs(x[k] - resistanceExponentialThreshold) < 2 * h)) continue;
+            double f[2];
+            bool sameCase = true;
+            for (int side = 0; side < 2; side++) {
+                double y[numGradients];
+                memcpy(y, x, sizeof(y));
+                y[k] += side ? h : -h;
+                memset(cityChar, 0, sizeof(cityChar));
+                CharacterizeCity(y[gradW], y[gradB], y[gradR], y[gradP], y[gradD], cityChar);
+                sameCase = sameCase && ((int)cityChar[caseNum] == g.caseNum);
+                f[side] = cityChar[tc];
+            }
+            if (!sameCase) continue;
+            double fd = (f[1] - f[0]) / (2 * h);
+            if (fabs(fd - g.dtc[k]) > 1e-5 * fabs(g.dtc[k]) + 1e-6 * fabs(g.tc)) {
+                cerr << "Derivative " << k << " of tc is " << g.dtc[k] << ", finite difference " << fd
+                     << " for W=" << x[gradW] << ", R=" << x[gradR] << ", P=" << x[gradP] << ", D=" << x[gradD] << ", B=" << x[gradB] << "\n";
+                return false;
+            }
+            checked++;
+        }
+    }
+    if (checked == 0) {
+        cerr << "No derivative of CharacterizeCityGradient was checked\n";
+        return false;
+    }
+    return true;
+}
+
+// The prepared dike cost must be bit-identical to CalculateDikeCost, and the table close to it
+bool DikeCostPathsMatch() {
+    DikeCostTable table;
+    BuildDikeCostTable(0.0, CEC, 170, &cityDikeCost, &table);
+    for (int k = 0; k <= 1700; k++) {
+        double hd = k * CEC / 1700;
+        double exact = CalculateDikeCost(hd, UnitCostPerVolumeDike, CitySlope, CityWidth, SlopeDike, WidthDikeTop, DikeStartingCostPoint);
+        if (CalculateDikeCostPrepared(hd, &cityDikeCost) != exact) {
+            cerr << "Prepared dike cost does not match CalculateDikeCost at hd=" << hd << "\n";
+            return false;
+        }
+        if (fabs(DikeCostFromTable(hd, &table, &cityDikeCost) - exact) > 1e-12 * exact) {
+            cerr << "Tabulated dike cost is off at hd=" << hd << "\n";
+            return false;
+        }
+    }
+    if (table.maxRelError > 1e-12) {
+        cerr << "Dike cost table midpoint error " << table.maxRelError << " exceeds 1e-12\n";
+        return false;
+    }
+    return true;
+}
+
+// Run CalculateDamageBlock over a surge ramp for every test case city, with the dike failing on
+// every third event, and compare each damage vector with CalculateDamage
+bool DamageBlockMatchesScalar(const vector<TestCase>& test_cases) {
+    const int n = 200;  // more than three mask words, the last one partial
+    vector<double> surge(n);
+    vector<uint64_t> breach((n+63)/64, 0);
+    for (int i = 0; i < n; i++) {
+        surge[i] = i * 0.1;
+        if (i % 3 == 0) breach[i>>6] |= (uint64_t)1 << (i&63);
+    }
+    vector<double> block(dvLength*n);
+    for (const auto& tc : test_cases) {
+        double cityChar[27];
+        memset(cityChar, 0, sizeof(cityChar));
+        CharacterizeCity(tc.W, tc.B, tc.R, tc.P, tc.D, cityChar);
+        for (int withMask = 0; withMask < 2; withMask++) {
+            CalculateDamageBlock(cityChar, n, surge.data(), withMask ? breach.data() : NULL, block.data());
+            for (int i = 0; i < n; i++) {
+                double damageVector[dvLength];
+                CalculateDamage(cityChar, surge[i], withMask && (i % 3 == 0), damageVector);
+                for (int k = 0; k < dvLength; k++) {
+                    if (block[k*n+i] != damageVector[k]) {
+                        cerr << "CalculateDamageBlock does not match CalculateDamage for " << tc.name
+                             << " at surge=" << surge[i] << "\n";
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// Simulate a synthetic surge block in both layouts for every test case city and compare the
+// per-sequence totals with CalculateDamage summed year by year
+bool SurgeBlockLayoutsMatch(const vector<TestCase>& test_cases) {
+    const int nS = 130, nY = lengthSurgeSequences;  // partial tiles in both directions
+    vector<double> bySequence(nS*nY), byYear(nS*nY);
+    SurgeBlock seqBlock = {bySequence.data(), NULL, nS, nY, sequenceMajor};
+    SurgeBlock yearBlock = {byYear.data(), NULL, nS, nY, yearMajor};
+    vector<uint64_t> seqMask(nS*SurgeRowWords(&seqBlock), 0), yearMask(nY*SurgeRowWords(&yearBlock), 0);
+    for (int s = 0; s < nS; s++) {
+        for (int y = 0; y < nY; y++) {
+            double surge = 8 * fabs(sin(s * 12.9898 + y * 78.233));
+            bySequence[s*nY+y] = surge;
+            byYear[y*nS+s] = surge;
+            if ((s + y) % 7 == 0) {
+                seqMask[s*SurgeRowWords(&seqBlock) + y/64] |= (uint64_t)1 << (y%64);
+                yearMask[y*SurgeRowWords(&yearBlock) + s/64] |= (uint64_t)1 << (s%64);
+            }
+        }
+    }
+    vector<double> damage[2] = {vector<double>(nS), vector<double>(nS)};
+    vector<int> counts[2][3];
+    for (auto& layoutCounts : counts) for (auto& c : layoutCounts) c.resize(nS);
+
+    for (const auto& tc : test_cases) {
+        double cityChar[27];
+        memset(cityChar, 0, sizeof(cityChar));
+        CharacterizeCity(tc.W, tc.B, tc.R, tc.P, tc.D, cityChar);
+        for (int withMask = 0; withMask < 2; withMask++) {
+            seqBlock.breachMask = withMask ? seqMask.data() : NULL;
+            yearBlock.breachMask = withMask ? yearMask.data() : NULL;
+            SurgeBlock * blocks[2] = {&seqBlock, &yearBlock};
+            for (int k = 0; k < 2; k++) {
+                SequenceDamage out = {damage[k].data(), counts[k][0].data(), counts[k][1].data(), counts[k][2].data()};
+                SimulateSurgeBlock(cityChar, blocks[k], out);
+            }
+            for (int s = 0; s < nS; s++) {
+                double total = 0;
+                int events[3] = {0, 0, 0};
+                for (int y = 0; y < nY; y++) {
+                    double damageVector[dvLength];
+                    CalculateDamage(cityChar, bySequence[s*nY+y], withMask && (s + y) % 7 == 0, damageVector);
+                    total += damageVector[dvt];
+                    events[0] += (int)damageVector[dvFE];
+                    events[1] += (int)damageVector[dvBE];
+                    events[2] += (int)damageVector[dvTE];
+                }
+                for (int k = 0; k < 2; k++) {
+                    bool match = (damage[k][s] == total);
+                    for (int e = 0; e < 3; e++) match = match && (counts[k][e][s] == events[e]);
+                    if (!match) {
+                        cerr << "SimulateSurgeBlock (" << (k ? "year" : "sequence") << "-major) does not match "
+                             << "CalculateDamage for " << tc.name << " at sequence " << s << "\n";
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// Surge blocks read from float64 and float32 surge files must simulate exactly like the same
+// surges held in memory (rounded to float for the float32 file), across several blocks
+bool SurgeFileMatchesMemory(const vector<TestCase>& test_cases) {
+    SurgeGenerator gen = {77, 1.2, 0.9, 0.1};
+    const int nS = 2 * maxSurgeBlock + 37, nY = 6;
+    vector<double> surge((size_t)nS * nY);
+    GenerateSurges(&gen, 0, surge.data(), nS, nY, sequenceMajor, 0, nS);
+    // rounded through a float vector: GCC 12 at -O3 -march=native (AVX-512) miscompiles a
+    // (double)(float) copy loop here, leaving its last elements unconverted
+    vector<float> narrow(surge.begin(), surge.end());
+    vector<double> rounded(narrow.begin(), narrow.end());
+    vector<double> expected(maxSurgeBlock), actual(maxSurgeBlock);
+    vector<int> counts(6 * maxSurgeBlock);
+    SequenceDamage expectedSeq = {expected.data(), &counts[0], &counts[maxSurgeBlock], &counts[2 * maxSurgeBlock]};
+    SequenceDamage actualSeq = {actual.data(), &counts[3 * maxSurgeBlock], &counts[4 * maxSurgeBlock], &counts[5 * maxSurgeBlock]};
+    const TestCase& tc = test_cases[2];
+    double cityChar[numCityChar];
+    memset(cityChar, 0, sizeof(cityChar));
+    CharacterizeCity(tc.W, tc.B, tc.R, tc.P, tc.D, cityChar);
+
+    bool ok = true;
+    for (uint32_t type : {columnFloat64, columnFloat32}) {
+        const char * path = "outputs/surge_check.srg";
+        const vector<double>& reference = (type == columnFloat64) ? surge : rounded;
+        SurgeFile file;
+        file.base = NULL;
+        ok = ok && WriteSurgeFile(path, surge.data(), nS, nY, type) && OpenSurgeFile(path, true, &file) &&
+             file.numSequences == nS && file.numYears == nY && SurgeFileBlocks(&file) == 3;
+        for (int k = 0; ok && k < SurgeFileBlocks(&file); k++) {
+            SurgeBlock block;
+            ok = SurgeFileBlock(&file, k, &block);
+            SurgeBlock memory = {reference.data() + (size_t)k * maxSurgeBlock * nY, NULL, block.numSequences, nY, sequenceMajor};
+            // float64 blocks are views of the mapping, not copies
+            bool inMapping = (const char *)block.surge >= file.base && (const char *)block.surge < file.base + file.bytes;
+            ok = ok && (inMapping == (type == columnFloat64)) &&
+                 block.numSequences == std::min(maxSurgeBlock, nS - k * maxSurgeBlock);
+            if (!ok) break;
+            SimulateSurgeBlock(cityChar, &memory, expectedSeq);
+            SimulateSurgeBlock(cityChar, &block, actualSeq);
+            for (int s = 0; ok && s < block.numSequences; s++) {
+                ok = (expected[s] == actual[s]) && (expectedSeq.breachEvents[s] == actualSeq.breachEvents[s]);
+            }
+        }
+        if (ok) {
+            // the whole file at once, against the block-by-block totals of the last block
+            vector<double> all(nS);
+            vector<int> allCounts(3 * nS);
+            SequenceDamage allSeq = {all.data(), &allCounts[0], &allCounts[nS], &allCounts[2 * nS]};
+            ok = SimulateSurgeFile(cityChar, &file, allSeq);
+            for (int s = 2 * maxSurgeBlock; ok && s < nS; s++) ok = (all[s] == actual[s - 2 * maxSurgeBlock]);
+        }
+        if (file.base) CloseSurgeFile(&file);
+        remove(path);
+    }
+    if (!ok) cerr << "Surge file blocks do not match the surges in memory\n";
+    return ok;
+}
+
+// Strategies with equal effective levers must have equal cityChar rows, and cities that cannot
+// alias must have distinct keys. A serial sweep must take the score of every alias after the
+// first from the cache; SweepMatchesSerial checks that the fanned-out scores are exact.
+bool DeduplicationMatches() {
+    SweepGrid grid = {{0, 1, 4}, {0, 0.05, 5}, {0, 0.25, 5}, {0, 1, 6}, {0, 0.05, 5}};
+    std::unordered_map<CityKey, vector<double>, CityKeyHash> cities;
+    int64_t aliases = 0;
+    bool ok = true;
+    for (int64_t index = 0; ok && index < grid.Size(); index++) {
+        int64_t k = index;
+        double B = grid.B.Value(k % grid.B.count); k /= grid.B.count;
+        double D = grid.D.Value(k % grid.D.count); k /= grid.D.count;
+        double P = grid.P.Value(k % grid.P.count); k /= grid.P.count;
+        double R = grid.R.Value(k % grid.R.count); k /= grid.R.count;
+        double W = grid.W.Value(k);
+        vector<double> cityChar(numCityChar, 0.0);
+        CharacterizeCity(W, B, R, P, D, cityChar.data());
+        auto found = cities.emplace(MakeCityKey(cityChar.data()), cityChar);
+        if (found.second) continue;
+        ok = CityMayAlias(cityChar.data()) && memcmp(found.first->second.data(), cityChar.data(), sizeof(double) * numCityChar) == 0;
+        aliases++;
+    }
+    const int nS = 4, nY = 30;
+    vector<double> surge(nS * nY);
+    for (int i = 0; i < nS * nY; i++) surge[i] = 6 * fabs(sin(i * 2.7183));
+    SurgeBlock block = {surge.data(), NULL, nS, nY, sequenceMajor};
+    SweepResult serial = SweepStrategies(grid, &block, 1);
+    SweepResult threaded = SweepStrategies(grid, &block, 3);
+    ok = ok && aliases > 0 && serial.deduplicated == aliases && threaded.deduplicated > 0 &&
+         threaded.deduplicated <= aliases && threaded.best.index == serial.best.index &&
+         threaded.best.totalCost == serial.best.totalCost && threaded.pareto.size() == serial.pareto.size();
+    if (!ok) cerr << "Sweep deduplication took " << serial.deduplicated << " of " << aliases << " aliases\n";
+    return ok;
+}
+
+// Write a small sweep to a column file, map it back and compare every row with CharacterizeCity
+bool ColumnFileRoundTrip() {
+    SweepGrid grid = {{0, 2, 3}, {0, 1.5, 4}, {0, 0.4, 3}, {0, 1, 5}, {0, 1, 4}};
+    const char * path = "outputs/sweep_check.col";
+    ColumnFile file;
+    if (!CreateColumnFile(path, sweepColumns, numSweepColumns, grid.Size(), &file)) return false;
+    SweepResult result = SweepStrategies(grid, NULL, 3, ParetoEpsilon(), &file);
+    bool ok = CloseColumnFile(&file) && result.rowsWritten;
+    ColumnFileView view;
+    ok = ok && OpenColumnFile(path, &view) && view.numRows == (uint64_t)grid.Size();
+    if (ok) {
+        const double * W = (const double *)FindColumn(&view, "W", columnFloat64);
+        const double * B = (const double *)FindColumn(&view, "B", columnFloat64);
+        const double * tcCol = (const double *)FindColumn(&view, "tc", columnFloat64);
+        const double * tz3Col = (const double *)FindColumn(&view, "tz3", columnFloat64);
+        const int32_t * cases = (const int32_t *)FindColumn(&view, "caseNum", columnInt32);
+        ok = W && B && tcCol && tz3Col && cases && !FindColumn(&view, "caseNum", columnFloat64) &&
+             ((uintptr_t)W % 64 == 0);
+        for (int64_t index = 0; ok && index < grid.Size(); index++) {
+            int64_t k = index;
+            double b = grid.B.Value(k % grid.B.count); k /= grid.B.count;
+            double d = grid.D.Value(k % grid.D.count); k /= grid.D.count;
+            double p = grid.P.Value(k % grid.P.count); k /= grid.P.count;
+            double r = grid.R.Value(k % grid.R.count); k /= grid.R.count;
+            double w = grid.W.Value(k);
+            double cityChar[numCityChar];
+            memset(cityChar, 0, sizeof(cityChar));
+            CharacterizeCity(w, b, r, p, d, cityChar);
+            ok = (W[index] == w) && (B[index] == b) && (cases[index] == (int)cityChar[caseNum]) &&
+                 (tcCol[index] == cityChar[tc]) && (tz3Col[index] == cityChar[tz3]);
+        }
+        CloseColumnFileView(&view);
+    }
+    remove(path);
+    if (!ok) cerr << "Sweep column file does not round-trip\n";
+    return ok;
+}
+
+// Sweep a small grid with a short surge block on several thread counts and compare the best
+// strategy and Pareto front with a serial evaluation through CharacterizeCity. W runs up to CEC
+// and W + B + D past it, so the sweep must also leave out the same infeasible strategies.
+bool SweepMatchesSerial() {
+    SweepGrid grid = {{0, CEC / 4, 5}, {0, 1.5, 5}, {0, 0.4, 3}, {0, 1, 6}, {0, 1, 5}};
+    const int nS = 8, nY = 40;
+    vector<double> surge(nS * nY);
+    for (int i = 0; i < nS * nY; i++) surge[i] = 7 * fabs(sin(i * 4.1414));
+    SurgeBlock block = {surge.data(), NULL, nS, nY, sequenceMajor};
+    // the dike fails in a fixed scattering of years, so breach frequency varies with the strategy
+    vector<uint64_t> breachMask(nS * SurgeRowWords(&block));
+    for (size_t k = 0; k < breachMask.size(); k++) breachMask[k] = 0x9249249249249249ull >> (k % 3);
+    block.breachMask = breachMask.data();
+    vector<double> seqDamage(nS);
+    vector<int> seqCounts(3 * nS);
+    SequenceDamage seq = {seqDamage.data(), seqCounts.data(), seqCounts.data() + nS, seqCounts.data() + 2 * nS};
+
+    SweepCandidate best = {};
+    best.totalCost = INFINITY;
+    int64_t caseHits[10] = {0}, infeasible = 0;
+    ParetoArchive front, coarse;
+    coarse.epsilon.tic = 2e9;
+    coarse.epsilon.damage = 5e8;
+    coarse.epsilon.breachFrequency = 0.05;
+    for (int64_t index = 0; index < grid.Size(); index++) {
+        int64_t k = index;
+        double B = grid.B.Value(k % grid.B.count); k /= grid.B.count;
+        double D = grid.D.Value(k % grid.D.count); k /= grid.D.count;
+        double P = grid.P.Value(k % grid.P.count); k /= grid.P.count;
+        double R = grid.R.Value(k % grid.R.count); k /= grid.R.count;
+        double W = grid.W.Value(k);
+        double cityChar[27];
+        memset(cityChar, 0, sizeof(cityChar));
+        CharacterizeCity(W, B, R, P, D, cityChar);
+        caseHits[(int)cityChar[caseNum]]++;
+        if (!StrategyFeasible(W, B, D)) {
+            infeasible++;
+            continue;
+        }
+        SimulateSurgeBlock(cityChar, &block, seq);
+        double damage = 0, breaches = 0;
+        for (int s = 0; s < nS; s++) {
+            damage += seqDamage[s];
+            breaches += seq.breachEvents[s];
+        }
+        damage /= nS;
+        breaches /= (double)nS * nY;
+        SweepCandidate c = {index, W, R, P, D, B, cityChar[tic], damage, breaches, cityChar[tc] + damage, nS};
+        if (SweepBetter(c, best)) best = c;
+        ParetoInsert(front, c);
+        ParetoInsert(coarse, c);
+    }
+    SortByInvestment(front.members);
+    SortByInvestment(coarse.members);
+    // the exact front is non-dominated; the coarse one keeps fewer strategies
+    for (const auto& a : front.members) for (const auto& b : front.members) {
+        if (&a != &b && a.tic <= b.tic && a.damage <= b.damage && a.breachFrequency <= b.breachFrequency &&
+            (a.tic < b.tic || a.damage < b.damage || a.breachFrequency < b.breachFrequency)) {
+            cerr << "Pareto archive holds dominated strategy " << b.index << "\n";
+            return false;
+        }
+    }
+    if (coarse.members.empty() || coarse.members.size() >= front.members.size()) {
+        cerr << "Epsilon archive keeps " << coarse.members.size() << " of " << front.members.size() << " strategies\n";
+        return false;
+    }
+
+    for (int numThreads : {1, 3, 8}) {
+        for (const ParetoArchive * serial : {&front, &coarse}) {
+            SweepResult result = SweepStrategies(grid, &block, numThreads, serial->epsilon);
+            const vector<SweepCandidate>& expected = serial->members;
+            bool match = (result.evaluated == grid.Size()) && (result.infeasible == infeasible) && (infeasible > 0) &&
+                         (result.best.index == best.index) && (result.best.totalCost == best.totalCost) &&
+                         StrategyFeasible(result.best.W, result.best.B, result.best.D) &&
+                         (result.pareto.size() == expected.size());
+            for (size_t i = 0; match && i < expected.size(); i++) {
+                match = (result.pareto[i].index == expected[i].index) && (result.pareto[i].damage == expected[i].damage) &&
+                        (result.pareto[i].breachFrequency == expected[i].breachFrequency) &&
+                        (result.pareto[i].sequences == expected[i].sequences);
+            }
+            // pruning must keep the best strategy and skip some of the scoring
+            SweepResult pruned = SweepStrategies(grid, &block, numThreads, serial->epsilon, NULL, true);
+            match = match && (pruned.evaluated == grid.Size()) && (pruned.pruned > 0) && (pruned.infeasible == infeasible) &&
+                    (pruned.best.index == best.index) && (pruned.best.totalCost == best.totalCost);
+            // a pruned sweep cannot know its front, so it must not return one
+            match = match && result.paretoValid && !pruned.paretoValid && pruned.pareto.empty();
+            // the per-thread case counters must add up to the serial counts
+            for (int c = 1; instrumented && match && c <= 9; c++) match = (result.stats.caseHits[c] == caseHits[c]);
+            if (!match) {
+                cerr << "SweepStrategies on " << numThreads << " threads does not match the serial sweep\n";
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Check Philox4x32-10 against the Random123 known-answer vectors, then check that generated
+// surge blocks are the same in both layouts, on any thread count and for any block offset
+bool SurgeGeneratorReproducible() {
+    const uint32_t kat[2][4] = {{0x6627e8d5u, 0xe169c58du, 0xbc57ac4cu, 0x9b00dbd8u},    // counter 0, key 0
+                                {0x408f276du, 0x41c83b0eu, 0xa20bc7c6u, 0x6d5451fdu}};   // all bits set
+    for (int k = 0; k < 2; k++) {
+        uint32_t v = k ? 0xffffffffu : 0, c0 = v, c1 = v, c2 = v, c3 = v;
+        Philox4x32(c0, c1, c2, c3, v, v);
+        if (c0 != kat[k][0] || c1 != kat[k][1] || c2 != kat[k][2] || c3 != kat[k][3]) {
+            cerr << "Philox4x32 does not match the known-answer test\n";
+            return false;
+        }
+    }
+
+    SurgeGenerator gen = {20190611, 1.5, 0.75, 0.1};
+    const int nS = 130, nY = lengthSurgeSequences;
+    vector<double> bySequence(nS*nY), byYear(nS*nY), threaded(nS*nY), offset(64*nY);
+    GenerateSurges(&gen, 1000, bySequence.data(), nS, nY, sequenceMajor, 0, nS);
+    GenerateSurgesParallel(&gen, 1000, byYear.data(), nS, nY, yearMajor, 1);
+    GenerateSurgesParallel(&gen, 1000, threaded.data(), nS, nY, yearMajor, 7);
+    GenerateSurges(&gen, 1000 + 50, offset.data(), 64, nY, sequenceMajor, 0, 64);
+    for (int s = 0; s < nS; s++) {
+        for (int y = 0; y < nY; y++) {
+            double surge = bySequence[s*nY+y];
+            double u0, u1;
+            CounterUniforms(gen.seed, surgeStream, 1000 + s, y, &u0, &u1);
+            bool match = (byYear[y*nS+s] == surge) && (threaded[y*nS+s] == surge) &&
+                         (GevQuantile(&gen, u0) == surge) && (s < 50 || s >= 114 || offset[(s-50)*nY+y] == surge);
+            if (!match) {
+                cerr << "Generated surges are not reproducible at sequence " << s << ", year " << y << "\n";
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Sample dike failures over generated surge blocks in both layouts for every test case city and
+// compare every mask bit with the uniform at its counter against DikeFailureProbability
+bool DikeFailureSamplesMatch(const vector<TestCase>& test_cases) {
+    SurgeGenerator gen = {42, 2.0, 1.0, 0.1};
+    const int nS = 100, nY = 70;
+    vector<double> bySequence(nS*nY), byYear(nS*nY);
+    GenerateSurges(&gen, 7, bySequence.data(), nS, nY, sequenceMajor, 0, nS);
+    GenerateSurges(&gen, 7, byYear.data(), nS, nY, yearMajor, 0, nS);
+    SurgeBlock seqBlock = {bySequence.data(), NULL, nS, nY, sequenceMajor};
+    SurgeBlock yearBlock = {byYear.data(), NULL, nS, nY, yearMajor};
+    vector<uint64_t> seqMask(nS*SurgeRowWords(&seqBlock)), yearMask(nY*SurgeRowWords(&yearBlock));
+    for (const auto& tc : test_cases) {
+        double cityChar[27];
+        memset(cityChar, 0, sizeof(cityChar));
+        CharacterizeCity(tc.W, tc.B, tc.R, tc.P, tc.D, cityChar);
+        SampleDikeFailures(cityChar, &gen, 7, &seqBlock, seqMask.data());
+        SampleDikeFailures(cityChar, &gen, 7, &yearBlock, yearMask.data());
+        for (int s = 0; s < nS; s++) {
+            for (int y = 0; y < nY; y++) {
+                double u0, u1;
+                CounterUniforms(gen.seed, breachStream, 7 + s, y, &u0, &u1);
+                bool failed = u0 < DikeFailureProbability(SurgeAtDike(cityChar, bySequence[s*nY+y]), cityChar[dh]);
+                bool seqBit = (seqMask[s*SurgeRowWords(&seqBlock) + y/64] >> (y%64)) & 1;
+                bool yearBit = (yearMask[y*SurgeRowWords(&yearBlock) + s/64] >> (s%64)) & 1;
+                if (seqBit != failed || yearBit != failed) {
+                    cerr << "SampleDikeFailures does not match DikeFailureProbability for " << tc.name
+                         << " at sequence " << s << ", year " << y << "\n";
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// Strategies scored from arena scratch, reset between strategies, must match scoring with
+// separately allocated buffers; the arena must hand out aligned memory, reuse it after a reset,
+// fit a full maxSurgeBlock x lengthSurgeSequences evaluation and refuse to overflow
+bool EvaluationArenaMatches(const vector<TestCase>& test_cases) {
+    SurgeGenerator gen = {42, 2.0, 1.0, 0.1};
+    const int nS = 300, nY = lengthSurgeSequences;
+    vector<double> surge(nS*nY);
+    for (int layout = sequenceMajor; layout <= yearMajor; layout++) {
+        GenerateSurges(&gen, 7, surge.data(), nS, nY, layout, 0, nS);
+        SurgeBlock block = {surge.data(), NULL, nS, nY, layout};
+        EvaluationArena arena;
+        if (!InitEvaluationArena(&arena, SurgeEvaluationBytes(&block))) return false;
+        vector<uint64_t> mask((layout == yearMajor ? nY : nS) * SurgeRowWords(&block));
+        vector<double> seqDamage(nS);
+        vector<int> seqCounts(3 * nS);
+        SequenceDamage totals = {seqDamage.data(), seqCounts.data(), seqCounts.data() + nS, seqCounts.data() + 2 * nS};
+        double * firstCityChar = NULL;
+        bool ok = true;
+        for (const auto& tc : test_cases) {
+            ResetEvaluationArena(&arena);
+            SurgeEvaluation eval;
+            ok = ok && ArenaSurgeEvaluation(&arena, &block, &eval);
+            if (!ok) break;
+            if (!firstCityChar) firstCityChar = eval.cityChar;
+            ok = ok && (eval.cityChar == firstCityChar) && ((uintptr_t)eval.breachMask % arenaAlignment == 0) &&
+                 ((uintptr_t)eval.totals.thresholdEvents % arenaAlignment == 0);
+            memset(eval.cityChar, 0, numCityChar * sizeof(double));
+            CharacterizeCity(tc.W, tc.B, tc.R, tc.P, tc.D, eval.cityChar);
+            double breachFrequency;
+            double damage = ScoreSampledBreaches(&gen, 7, &block, &eval, &breachFrequency);
+
+            SampleDikeFailures(eval.cityChar, &gen, 7, &block, mask.data());
+            SurgeBlock sampled = {surge.data(), mask.data(), nS, nY, layout};
+            SimulateSurgeBlock(eval.cityChar, &sampled, totals);
+            double expected = 0, breaches = 0;
+            for (int s = 0; s < nS; s++) {
+                expected += seqDamage[s];
+                breaches += totals.breachEvents[s];
+            }
+            ok = ok && (damage == expected / nS) && (breachFrequency == breaches / ((double)nS * nY));
+            if (!ok) cerr << "Arena surge evaluation does not match for " << tc.name << "\n";
+        }
+        ok = ok && (arena.peak <= arena.capacity) && (ArenaAlloc<char>(&arena, arena.capacity) == NULL) && (arena.used <= arena.peak);
+        FreeEvaluationArena(&arena);
+        if (!ok) return false;
+    }
+    SurgeBlock full = {NULL, NULL, maxSurgeBlock, lengthSurgeSequences, sequenceMajor};
+    EvaluationArena arena;
+    if (!InitEvaluationArena(&arena, SurgeEvaluationBytes(&full))) return false;
+    SurgeEvaluation eval;
+    bool fits = ArenaSurgeEvaluation(&arena, &full, &eval);
+    FreeEvaluationArena(&arena);
+    if (!fits) cerr << "A full surge block evaluation does not fit SurgeEvaluationBytes\n";
+    return fits;
+}
+
+// The dynamic simulator must match a year-by-year evaluation that re-characterizes the city
+// every year, for a static strategy and an adaptive one, with sea level rise and discounting
+bool DynamicMatchesYearly() {
+    SurgeGenerator gen = {11, 1.5, 0.8, 0.1};
+    const int nS = 100, nY = lengthSurgeSequences;
+    const double rate = 0.03;
+    vector<double> msl(nY), surge(nS * nY), damage(nS);
+    for (int y = 0; y < nY; y++) msl[y] = 0.005 * y;
+    const LeverChange staticPlan[] = {{0, 2, 3, 0.8, 5, 1}};
+    const LeverChange adaptivePlan[] = {{0, 0, 0, 0, 2, 0}, {30, 0, 0, 0, 4, 1}, {30, 0, 2, 0, 0, 0},
+                                        {80, 1, 0, 0, 0, 0}, {120, 0, 0, 0, 3, 0}, {150, 0, 3, 0.8, 0, 0}};
+    struct Plan { const LeverChange * changes; int numChanges; int numEpochs; };
+    const Plan plans[] = {{staticPlan, 1, 1}, {adaptivePlan, 6, 4}};
+    for (int layout = sequenceMajor; layout <= yearMajor; layout++) {
+        GenerateSurges(&gen, 3, surge.data(), nS, nY, layout, 0, nS);
+        SurgeBlock block = {surge.data(), NULL, nS, nY, layout};
+        for (const Plan& plan : plans) {
+            DynamicOutcome outcome = SimulateDynamicStrategy(plan.changes, plan.numChanges, &gen, 3, &block, msl.data(), rate, damage.data());
+            bool ok = (outcome.numEpochs == plan.numEpochs);
+            for (int s = 0; ok && s < nS; s++) {
+                double levers[5] = {0, 0, 0, 0, 0}, previousTic = 0, investment = 0, expected = 0;
+                for (int y = 0; y < nY; y++) {
+                    for (int k = 0; k < plan.numChanges; k++) {
+                        const LeverChange& c = plan.changes[k];
+                        if (c.year != y) continue;
+                        levers[0] = std::max(levers[0], c.W); levers[1] = std::max(levers[1], c.R);
+                        levers[2] = std::max(levers[2], c.P); levers[3] = std::max(levers[3], c.D);
+                        levers[4] = std::max(levers[4], c.B);
+                    }
+                    double cityChar[numCityChar];
+                    memset(cityChar, 0, sizeof(cityChar));
+                    CharacterizeCity(levers[0], levers[4], levers[1], levers[2], levers[3], cityChar);
+                    investment += std::max(0.0, cityChar[tic] - previousTic) * DynamicDiscount(rate, y);
+                    previousTic = cityChar[tic];
+                    double h = ((layout == yearMajor) ? surge[y * nS + s] : surge[s * nY + y]) + msl[y];
+                    double u0, u1, dv[dvLength];
+                    CounterUniforms(gen.seed, breachStream, 3 + s, y, &u0, &u1);
+                    CalculateDamage(cityChar, h, u0 < DikeFailureProbability(SurgeAtDike(cityChar, h), cityChar[dh]), dv);
+                    expected += dv[dvt] * DynamicDiscount(rate, y);
+                }
+                ok = (damage[s] == expected) && (outcome.investment == investment);
+            }
+            if (!ok) {
+                cerr << "SimulateDynamicStrategy does not match the year-by-year evaluation\n";
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// The optimiser must reach at least the best point of a grid over the policy fractions, give
+// the same result on any thread count and report totals that rescoring its best levers
+// reproduces, with and without a surge block
+bool OptimiserFindsGridOptimum() {
+    const int steps = 6, size = steps * steps * steps * steps * steps;
+    vector<double> W(size), R(size), P(size), D(size), B(size), tcCol(size), damage(size), breaches(size);
+    for (int i = 0; i < size; i++) {
+        double x[numPolicyFractions];
+        for (int j = 0, k = i; j < numPolicyFractions; j++, k /= steps) x[j] = (k % steps) / (steps - 1.0);
+        PolicyLevers(x, W[i], R[i], P[i], D[i], B[i]);
+    }
+    ScorePopulation(size, W.data(), R.data(), P.data(), D.data(), B.data(), NULL, NULL, 0, 1, NULL,
+                    tcCol.data(), damage.data(), breaches.data());
+    double gridBest = INFINITY;
+    for (int i = 0; i < size; i++) gridBest = std::min(gridBest, tcCol[i]);
+
+    SurgeGenerator gen = {7, 2.5, 1.0, 0.1};
+    const int nS = 20, nY = 50;
+    vector<double> surge(nS * nY);
+    GenerateSurges(&gen, 0, surge.data(), nS, nY, yearMajor, 0, nS);
+    SurgeBlock block = {surge.data(), NULL, nS, nY, yearMajor};
+    for (const SurgeBlock * surges : {(const SurgeBlock *)NULL, (const SurgeBlock *)&block}) {
+        OptimiserOptions options = {5, 16, surges ? 40 : 300, 0.3, 1e-8, 1};
+        OptimiserResult serial = OptimiseStrategy(surges, &gen, 0, options);
+        options.numThreads = 3;
+        OptimiserResult threaded = OptimiseStrategy(surges, &gen, 0, options);
+        if (!serial.scored || !threaded.scored) return false;
+        const SweepCandidate& b = serial.best;
+        double cityChar[numCityChar];
+        memset(cityChar, 0, sizeof(cityChar));
+        CharacterizeCity(b.W, b.B, b.R, b.P, b.D, cityChar);
+        double rescored = 0, breachFrequency = 0;
+        if (surges) {
+            EvaluationArena arena;
+            if (!InitEvaluationArena(&arena, SurgeEvaluationBytes(surges))) return false;
+            SurgeEvaluation eval;
+            if (!ArenaSurgeEvaluation(&arena, surges, &eval)) {
+                cerr << "A surge evaluation does not fit SurgeEvaluationBytes\n";
+                FreeEvaluationArena(&arena);
+                return false;
+            }
+            memcpy(eval.cityChar, cityChar, sizeof(cityChar));
+            rescored = ScoreSampledBreaches(&gen, 0, surges, &eval, &breachFrequency);
+            FreeEvaluationArena(&arena);
+        }
+        bool ok = (threaded.best.index == b.index) && (threaded.best.totalCost == b.totalCost) &&
+                  (b.totalCost == cityChar[tc] + rescored) && (b.damage == rescored) && (b.tic == cityChar[tic]) &&
+                  (b.W < CEC) && (b.W + b.B + b.D <= CEC) && (b.P < 1) && (surges || b.totalCost <= gridBest);
+        if (!ok) {
+            cerr << "OptimiseStrategy " << (surges ? "with" : "without") << " surges: total " << b.totalCost
+                 << " (grid best " << gridBest << ")\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+// Surge distribution of the expected annual damage outputs (seed unused)
+const SurgeGenerator eadSurges = {0, 2.5, 1.0, 0.1};
+
+// The cached-zone expected annual damage must agree with direct integration of
+// ExpectedDamageGivenSurge for the test cases and a lever grid, with the zone integrals
+// reused between strategies that share zone boundaries
+bool ExpectedDamageMatchesDirect(const vector<TestCase>& test_cases) {
+    LeverColumns levers = ConsistencyLevers(test_cases);
+    EadRange range = MakeEadRange(eadSurges);
+    for (const SurgeGenerator& gev : {eadSurges, SurgeGenerator{0, 4.0, 1.5, 0.0}}) {
+        EadZoneCache cache = MakeEadZoneCache(gev, 1e-10);
+        range = MakeEadRange(gev);
+        for (size_t i = 0; i < levers.W.size(); i++) {
+            double cityChar[27];
+            memset(cityChar, 0, sizeof(cityChar));
+            CharacterizeCity(levers.W[i], levers.B[i], levers.R[i], levers.P[i], levers.D[i], cityChar);
+            double cached = ExpectedAnnualDamage(cityChar, &cache);
+            double direct = ExpectedAnnualDamageDirect(cityChar, range, 1e-10);
+            if (fabs(cached - direct) > 1e-8 * fabs(direct) + 1e-6) {
+                cerr << "ExpectedAnnualDamage " << cached << " does not match direct integration " << direct
+                     << " for W=" << levers.W[i] << ", R=" << levers.R[i] << ", P=" << levers.P[i]
+                     << ", D=" << levers.D[i] << ", B=" << levers.B[i] << "\n";
+                return false;
+            }
+        }
+        if (cache.hits == 0) {
+            cerr << "ExpectedAnnualDamage never reused a zone integral\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+// Every sampling mode must agree with quadrature over the sampled range within 5 standard errors
+// for the test cases, and the quasi-random and stratified modes must beat plain sampling
+bool SamplingMatchesQuadrature(const vector<TestCase>& test_cases) {
+    EadRange range = SampledSurgeRange(eadSurges);
+    vector<SurgeSample> samples(numSamplingModes);
+    for (int mode = 0; mode < numSamplingModes; mode++)
+        if (!MakeSurgeSample(&eadSurges, DefaultSamplingOptions(mode, 24000, 1), &samples[mode])) return false;
+    // one point per stratum leaves the stratum variances undefined, so such a design is refused
+    SurgeSample tooSmall;
+    for (int64_t events : {(int64_t)numStrata, (int64_t)2 * numStrata - 1}) {
+        if (MakeSurgeSample(&eadSurges, DefaultSamplingOptions(stratifiedSampling, events, 1), &tooSmall)) {
+            cerr << "Stratified sampling accepted " << events << " events for " << numStrata << " strata\n";
+            return false;
+        }
+    }
+    for (const auto& tc : test_cases) {
+        double cityChar[27];
+        memset(cityChar, 0, sizeof(cityChar));
+        CharacterizeCity(tc.W, tc.B, tc.R, tc.P, tc.D, cityChar);
+        double ead = ExpectedAnnualDamageDirect(cityChar, range, 1e-10);
+        double plainError = 0;
+        for (int mode = 0; mode < numSamplingModes; mode++) {
+            DamageEstimate e = EstimateDamage(cityChar, samples[mode]);
+            if (mode == plainSampling) plainError = e.damageError;
+            bool ok = fabs(e.damage - ead) <= 5 * e.damageError + 1e-9 * ead && e.events == 24000;
+            if ((mode == quasiSampling || mode == stratifiedSampling) && ead > 0) ok = ok && e.damageError < plainError;
+            if (!ok) {
+                cerr << samplingModeNames[mode] << " sampling gives " << e.damage << " +- " << e.damageError
+                     << " against " << ead << " for " << tc.name << "\n";
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Adaptive scoring without a tolerance must score every sequence and agree with the full mean in
+// both layouts; with one it must stop on a sub-block boundary near the full mean, and against a
+// low incumbent at minSequences. A tolerance-only adaptive sweep must not depend on the thread
+// count and must score fewer sequences than the full sweep.
+bool AdaptiveStoppingMatches() {
+    const int nS = 1024, nY = lengthSurgeSequences;
+    SurgeGenerator gen = {424242, eadSurges.loc, eadSurges.scale, eadSurges.shape};
+    vector<double> byYear((size_t)nS * nY), bySequence((size_t)nS * nY);
+    GenerateSurges(&gen, 0, byYear.data(), nS, nY, yearMajor, 0, nS);
+    GenerateSurges(&gen, 0, bySequence.data(), nS, nY, sequenceMajor, 0, nS);
+    SurgeBlock yearBlock = {byYear.data(), NULL, nS, nY, yearMajor};
+    SurgeBlock sequenceBlock = {bySequence.data(), NULL, nS, nY, sequenceMajor};
+    vector<double> seqDamage(nS);
+    vector<int> seqCounts(3 * nS);
+    SequenceDamage seq = {seqDamage.data(), seqCounts.data(), seqCounts.data() + nS, seqCounts.data() + 2 * nS};
+
+    double cityChar[numCityChar];
+    memset(cityChar, 0, sizeof(cityChar));
+    CharacterizeCity(2, 1, 3, 0.8, 5, cityChar);
+    SimulateSurgeBlock(cityChar, &yearBlock, seq);
+    double full = 0;
+    for (int s = 0; s < nS; s++) full += seqDamage[s];
+    full /= nS;
+
+    AdaptiveStopping never;
+    never.relativeTolerance = 0;
+    never.stopWorse = false;
+    AdaptiveScore a = SimulateSurgeBlockAdaptive(cityChar, &yearBlock, seq, never, INFINITY);
+    AdaptiveScore b = SimulateSurgeBlockAdaptive(cityChar, &sequenceBlock, seq, never, INFINITY);
+    bool ok = a.sequences == nS && fabs(a.damage - full) <= 1e-12 * full && a.damage == b.damage &&
+              a.halfWidth == b.halfWidth && a.breachFrequency == b.breachFrequency && b.sequences == nS;
+
+    AdaptiveStopping loose;
+    loose.relativeTolerance = 0.02;
+    AdaptiveScore c = SimulateSurgeBlockAdaptive(cityChar, &yearBlock, seq, loose, INFINITY);
+    ok = ok && c.sequences < nS && c.sequences % loose.subBlock == 0 && fabs(c.damage - full) <= 3 * c.halfWidth &&
+         c.halfWidth <= loose.relativeTolerance * (cityChar[tc] + c.damage);
+    AdaptiveScore d = SimulateSurgeBlockAdaptive(cityChar, &yearBlock, seq, AdaptiveStopping(), 0.0);
+    ok = ok && d.sequences == AdaptiveStopping().minSequences;
+    if (!ok) {
+        cerr << "Adaptive surge scoring does not match the full block\n";
+        return false;
+    }
+
+    SweepGrid grid = {{0, 4, 3}, {0, 4, 3}, {0, 0.5, 2}, {0, 2, 4}, {0, 3, 2}};
+    loose.stopWorse = false;
+    SweepResult exact = SweepStrategies(grid, &yearBlock, 2);
+    SweepResult serial = SweepStrategies(grid, &yearBlock, 1, ParetoEpsilon(), NULL, false, &loose);
+    SweepResult threaded = SweepStrategies(grid, &yearBlock, 3, ParetoEpsilon(), NULL, false, &loose);
+    ok = exact.sequencesScored == (grid.Size() - exact.infeasible) * nS && serial.evaluated == grid.Size() &&
+         serial.sequencesScored < exact.sequencesScored && threaded.sequencesScored == serial.sequencesScored &&
+         threaded.best.index == serial.best.index && threaded.best.totalCost == serial.best.totalCost &&
+         serial.best.sequences >= loose.minSequences && serial.best.sequences <= nS;
+    AdaptiveStopping worse;
+    SweepResult stopped = SweepStrategies(grid, &yearBlock, 3, ParetoEpsilon(), NULL, false, &worse);
+    ok = ok && stopped.evaluated == grid.Size() && stopped.sequencesScored < exact.sequencesScored;
+    if (!ok) cerr << "Adaptive sweep does not match the full sweep\n";
+    return ok;
+}
+
+// A sweep stopped halfway and resumed from its checkpoint on another thread count must end with
+// the best, Pareto archive and rows of an uninterrupted sweep; resuming a finished checkpoint
+// must evaluate nothing. An optimiser run resumed after half its generations must end as the
+// uninterrupted run does.
+bool CheckpointResumeMatches() {
+    SweepGrid grid = {{0, 1, 4}, {0, 1.5, 5}, {0, 0.4, 3}, {0, 1, 6}, {0, 1, 5}};
+    const int nS = 8, nY = 40;
+    vector<double> surge(nS * nY);
+    for (int i = 0; i < nS * nY; i++) surge[i] = 7 * fabs(sin(i * 4.1414));
+    SurgeBlock block = {surge.data(), NULL, nS, nY, sequenceMajor};
+    ParetoEpsilon epsilon;
+    SweepResult full = SweepStrategies(grid, &block, 2);
+
+    const char * path = "outputs/sweep_check.ckpt";
+    const char * rowsPath = "outputs/sweep_check.col";
+    int64_t numChunks = (grid.Size() + sweepChunk - 1) / sweepChunk;
+    SweepCheckpoint checkpoint;
+    checkpoint.path = path;
+    checkpoint.intervalSeconds = 0;
+    checkpoint.maxChunks = numChunks / 2;
+    ColumnFile rows;
+    bool ok = CreateColumnFile(rowsPath, sweepColumns, numSweepColumns, grid.Size(), &rows);
+    SweepResult partial = SweepStrategies(grid, &block, 2, epsilon, &rows, false, NULL, &checkpoint);
+    ok = ok && CloseColumnFile(&rows) && partial.checkpointed && partial.evaluated == checkpoint.maxChunks * sweepChunk;
+    SweepProgress progress;
+    ok = ok && LoadSweepCheckpoint(path, grid, epsilon, checkpoint, nS, &progress) &&
+         progress.state.evaluated == partial.evaluated &&
+         std::count(progress.chunkDone.begin(), progress.chunkDone.end(), 1) == checkpoint.maxChunks;
+
+    checkpoint.resume = &progress;
+    checkpoint.maxChunks = 0;
+    ok = ok && ReopenColumnFile(rowsPath, sweepColumns, numSweepColumns, grid.Size(), &rows);
+    SweepResult resumed = ok ? SweepStrategies(grid, &block, 3, epsilon, &rows, false, NULL, &checkpoint) : full;
+    ok = ok && CloseColumnFile(&rows) && resumed.checkpointed && resumed.evaluated == full.evaluated &&
+         resumed.sequencesScored == full.sequencesScored && resumed.best.index == full.best.index &&
+         resumed.best.totalCost == full.best.totalCost && resumed.pareto.size() == full.pareto.size();
+    for (size_t i = 0; ok && i < full.pareto.size(); i++) {
+        ok = resumed.pareto[i].index == full.pareto[i].index && resumed.pareto[i].damage == full.pareto[i].damage &&
+             resumed.pareto[i].breachFrequency == full.pareto[i].breachFrequency;
+    }
+    ColumnFileView view;
+    ok = ok && OpenColumnFile(rowsPath, &view);
+    if (ok) {
+        const double * damage = (const double *)FindColumn(&view, "damage", columnFloat64);
+        const int32_t * sequences = (const int32_t *)FindColumn(&view, "sequences", columnInt32);
+        for (int64_t index = 0; ok && index < grid.Size(); index++) ok = damage[index] >= 0 && sequences[index] == nS;
+        CloseColumnFileView(&view);
+    }
+    SweepProgress finished;
+    ok = ok && LoadSweepCheckpoint(path, grid, epsilon, checkpoint, nS, &finished);
+    checkpoint.resume = &finished;
+    SweepResult again = ok ? SweepStrategies(grid, &block, 2, epsilon, NULL, false, NULL, &checkpoint) : full;
+    ok = ok && again.evaluated == full.evaluated && again.sequencesScored == full.sequencesScored &&
+         again.best.index == full.best.index && again.pareto.size() == full.pareto.size();
+    remove(path);
+    remove(rowsPath);
+    if (!ok) {
+        cerr << "Resumed sweep does not match the uninterrupted sweep\n";
+        return false;
+    }
+
+    SurgeGenerator gen = {7, 2.5, 1.0, 0.1};
+    vector<double> surges(20 * 50);
+    GenerateSurges(&gen, 0, surges.data(), 20, 50, yearMajor, 0, 20);
+    SurgeBlock optimiserBlock = {surges.data(), NULL, 20, 50, yearMajor};
+    OptimiserOptions options = {5, 16, 30, 0.3, 1e-8, 2};
+    OptimiserResult uninterrupted = OptimiseStrategy(&optimiserBlock, &gen, 0, options);
+    if (!uninterrupted.scored) return false;
+    options.maxGenerations = 15;
+    options.checkpointPath = path;
+    options.checkpointEvery = 4;
+    OptimiserResult first = OptimiseStrategy(&optimiserBlock, &gen, 0, options);
+    OptimiserState state;
+    ok = first.scored && first.checkpointed && LoadOptimiserCheckpoint(path, &optimiserBlock, &gen, 0, options, &state) &&
+         state.generation == 15 && state.evaluations == first.evaluations;
+    options.maxGenerations = 30;
+    options.checkpointPath = NULL;
+    options.resume = &state;
+    OptimiserResult second = ok ? OptimiseStrategy(&optimiserBlock, &gen, 0, options) : uninterrupted;
+    ok = ok && second.scored && second.generations == uninterrupted.generations && second.evaluations == uninterrupted.evaluations &&
+         second.best.index == uninterrupted.best.index && second.best.totalCost == uninterrupted.best.totalCost &&
+         second.best.tic == uninterrupted.best.tic;
+    for (int j = 0; ok && j < numPolicyFractions; j++) ok = second.fractions[j] == uninterrupted.fractions[j];
+    remove(path);
+    if (!ok) cerr << "Resumed optimisation does not match the uninterrupted run\n";
+    return ok;
+}
+
+// The icow.h entry points must return exactly what the kernels they wrap return
+bool CAbiMatchesKernels(const vector<TestCase>& test_cases) {
+    int n = test_cases.size();
+    LeverColumns lv;
+    for (const auto& tc : test_cases) {
+        lv.W.push_back(tc.W); lv.B.push_back(tc.B); lv.R.push_back(tc.R); lv.P.push_back(tc.P); lv.D.push_back(tc.D);
+    }
+    bool ok = (IcowAbiVersion() == ICOW_ABI_VERSION);
+    vector<double> rows(n * numCityChar), columns(ICOW_NUM_COLUMNS * n);
+    vector<int> cases(n);
+    IcowCharacterize(n, lv.W.data(), lv.B.data(), lv.R.data(), lv.P.data(), lv.D.data(), rows.data());
+    IcowCharacterizeColumns(n, lv.W.data(), lv.B.data(), lv.R.data(), lv.P.data(), lv.D.data(), cases.data(), columns.data());
+    vector<int> gradientCases(n);
+    vector<double> gradientTic(n), gradientTc(n), dtic(ICOW_NUM_GRADIENTS * n), dtc(ICOW_NUM_GRADIENTS * n);
+    IcowCharacterizeGradient(n, lv.W.data(), lv.B.data(), lv.R.data(), lv.P.data(), lv.D.data(), gradientCases.data(),
+                             gradientTic.data(), gradientTc.data(), dtic.data(), dtc.data());
+    const int columnEntries[ICOW_NUM_COLUMNS] = {wc, rc, dc, tic, tc, vz1, vz2, vz3, vz4, tz1, tz2, tz3, tz4};
+    const int nS = 70, nY = 3;                  // two mask words per year row
+    vector<double> surge(nS * nY);
+    for (int i = 0; i < nS * nY; i++) surge[i] = 6 * fabs(sin(i * 2.37));
+    SurgeBlock block = {surge.data(), NULL, nS, nY, yearMajor};
+    vector<uint64_t> mask(nY * SurgeRowWords(&block), 0x5555555555555555ull);
+    block.breachMask = mask.data();
+    vector<double> damage(n * nS), expectedDamage(nS);
+    vector<int> counts(3 * n * nS), expectedCounts(3 * nS);
+    IcowScoreSurgeBlock(n, rows.data(), surge.data(), mask.data(), nS, nY, yearMajor, damage.data(),
+                        counts.data(), counts.data() + n * nS, counts.data() + 2 * n * nS);
+    vector<double> ead(n);
+    IcowExpectedAnnualDamage(n, rows.data(), eadSurges.loc, eadSurges.scale, eadSurges.shape, 1e-10, ead.data());
+    EadZoneCache cache = MakeEadZoneCache(eadSurges, 1e-10);
+    for (int i = 0; ok && i < n; i++) {
+        double cityChar[numCityChar];
+        memset(cityChar, 0, sizeof(cityChar));
+        CharacterizeCity(lv.W[i], lv.B[i], lv.R[i], lv.P[i], lv.D[i], cityChar);
+        const double * row = &rows[i * numCityChar];
+        ok = memcmp(row, cityChar, sizeof(cityChar)) == 0 && cases[i] == (int)cityChar[caseNum];
+        for (int k = 0; k < ICOW_NUM_COLUMNS; k++) ok = ok && columns[k * n + i] == cityChar[columnEntries[k]];
+        CityGradient g;
+        CharacterizeCityGradient(lv.W[i], lv.B[i], lv.R[i], lv.P[i], lv.D[i], &g);
+        ok = ok && gradientCases[i] == g.caseNum && gradientTic[i] == g.tic && gradientTc[i] == g.tc;
+        for (int k = 0; k < numGradients; k++) ok = ok && dtic[k * n + i] == g.dtic[k] && dtc[k * n + i] == g.dtc[k];
+
+        double blockDamage[dvLength * nS], expectedBlock[dvLength * nS];
+        IcowDamage(row, nS, surge.data(), mask.data(), blockDamage);
+        CalculateDamageBlock(cityChar, nS, surge.data(), mask.data(), expectedBlock);
+        ok = ok && memcmp(blockDamage, expectedBlock, sizeof(blockDamage)) == 0;
+
+        SequenceDamage expected = {expectedDamage.data(), expectedCounts.data(), expectedCounts.data() + nS, expectedCounts.data() + 2 * nS};
+        SimulateSurgeBlock(cityChar, &block, expected);
+        for (int s = 0; s < nS; s++) {
+            ok = ok && damage[i * nS + s] == expectedDamage[s];
+            for (int e = 0; e < 3; e++) ok = ok && counts[(e * n + i) * nS + s] == expectedCounts[e * nS + s];
+        }
+        ok = ok && ead[i] == ExpectedAnnualDamage(cityChar, &cache);
+        if (!ok) cerr << "C ABI does not match the kernels for " << test_cases[i].name << "\n";
+    }
+    return ok;
+}
+
+// --sweep [step] [threads] [path]: sweep W, R, D, B from 0 to CEC and P from 0 to 1 in steps of
+// step (default 1 m and 0.1) on all or the given number of threads, reporting cost only
+// --columns: the test case results as column files, one row per test case. city.col holds every
+// cityChar entry; damage.col the surge, and the damage vector with the dike intact and failed.
+bool WriteTestCaseColumns(const vector<TestCase>& test_cases) {
+    int n = test_cases.size();
+    vector<ColumnSpec> citySpecs(numCityChar);
+    for (int k = 0; k < numCityChar; k++) citySpecs[k] = {cityCharNames[k], columnFloat64};
+    vector<string> damageNames = {"h_surge", "effective_surge", "dike_failure_probability"};
+    for (const char * side : {"_intact", "_failed"})
+        for (int k = 0; k < dvLength; k++) damageNames.push_back(string(damageVectorNames[k]) + side);
+    vector<ColumnSpec> damageSpecs;
+    for (const auto& name : damageNames) damageSpecs.push_back({name.c_str(), columnFloat64});
+
+    vector<vector<double>> city(numCityChar, vector<double>(n)), damage(damageSpecs.size(), vector<double>(n));
+    for (int i = 0; i < n; i++) {
+        const TestCase& tc = test_cases[i];
+        double cityChar[numCityChar], intact[dvLength], failed[dvLength];
+        memset(cityChar, 0, sizeof(cityChar));
+        CharacterizeCity(tc.W, tc.B, tc.R, tc.P, tc.D, cityChar);
+        CalculateDamage(cityChar, tc.h_surge, 0, intact);
+        CalculateDamage(cityChar, tc.h_surge, 1, failed);
+        for (int k = 0; k < numCityChar; k++) city[k][i] = cityChar[k];
+        damage[0][i] = tc.h_surge;
+        damage[1][i] = EffectiveSurge(tc.h_surge);
+        damage[2][i] = DikeFailureProbability(SurgeAtDike(cityChar, tc.h_surge), cityChar[dh]);
+        for (int k = 0; k < dvLength; k++) {
+            damage[3 + k][i] = intact[k];
+            damage[3 + dvLength + k][i] = failed[k];
+        }
+    }
+
+    ColumnFile cityFile, damageFile;
+    bool ok = CreateColumnFile("outputs/city.col", citySpecs.data(), numCityChar, n, &cityFile);
+    for (int k = 0; ok && k < numCityChar; k++) ok = WriteColumn(&cityFile, k, 0, n, city[k].data());
+    ok = CloseColumnFile(&cityFile) && ok;
+    ok = ok && CreateColumnFile("outputs/damage.col", damageSpecs.data(), damageSpecs.size(), n, &damageFile);
+    for (size_t k = 0; ok && k < damageSpecs.size(); k++) ok = WriteColumn(&damageFile, k, 0, n, damage[k].data());
+    ok = CloseColumnFile(&damageFile) && ok;
+    if (!ok) cerr << "Writing the test case column files failed\n";
+    return ok;
+}
+
+// Checkpoint flags of --sweep and --optimise, taken out of argv wherever they are:
+// --checkpoint path saves progress to path, --checkpoint-interval s every s seconds (sweep,
+// default 60) or generations (optimise, default 10), and --resume continues from path
+struct CheckpointFlags {
+    const char * path = NULL;
+    double interval = 0;
+    bool resume = false;
+};
+
+int TakeCheckpointFlags(int argc, char ** argv, CheckpointFlags * flags) {
+    int kept = 0;
+    for (int k = 0; k < argc; k++) {
+        if (strcmp(argv[k], "--checkpoint") == 0 && k + 1 < argc) flags->path = argv[++k];
+        else if (strcmp(argv[k], "--checkpoint-interval") == 0 && k + 1 < argc) flags->interval = atof(argv[++k]);
+        else if (strcmp(argv[k], "--resume") == 0) flags->resume = true;
+        else argv[kept++] = argv[k];
+    }
+    if (flags->resume && !flags->path) cerr << "--resume needs --checkpoint path\n";
+    return kept;
+}
+
+int RunSweep(int argc, char ** argv) {
+    CheckpointFlags flags;
+    argc = TakeCheckpointFlags(argc, argv, &flags);
+    if (flags.resume && !flags.path) return 1;
+    double step = (argc > 2) ? atof(argv[2]) : 1.0;
+    int numThreads = (argc > 3) ? atoi(argv[3]) : 0;
+    int nHeight = (int)floor(CEC / step + 1e-9) + 1;
+    const char * columnPath = (argc > 4) ? argv[4] : NULL;
+    SweepGrid grid = {{0, step, nHeight}, {0, step, nHeight}, {0, 0.1, 11}, {0, step, nHeight}, {0, step, nHeight}};
+    SweepCheckpoint checkpoint;
+    SweepProgress progress;
+    checkpoint.path = flags.path;
+    if (flags.interval > 0) checkpoint.intervalSeconds = flags.interval;
+    if (flags.resume) {
+        if (!LoadSweepCheckpoint(flags.path, grid, ParetoEpsilon(), checkpoint, -1, &progress)) return 1;
+        checkpoint.resume = &progress;
+    }
+    // a resumed sweep adds its rows to the file the checkpointed one was writing
+    ColumnFile file;
+    if (columnPath && !(flags.resume ? ReopenColumnFile(columnPath, sweepColumns, numSweepColumns, grid.Size(), &file)
+                                     : CreateColumnFile(columnPath, sweepColumns, numSweepColumns, grid.Size(), &file)))
+        return 1;
+    auto start = std::chrono::steady_clock::now();
+    SweepResult result = SweepStrategies(grid, NULL, numThreads, ParetoEpsilon(), columnPath ? &file : NULL, false, NULL,
+                                         flags.path ? &checkpoint : NULL);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (columnPath && (!CloseColumnFile(&file) || !result.rowsWritten)) {
+        cerr << "Writing " << columnPath << " failed\n";
+        return 1;
+    }
+    if (!result.checkpointed) return 1;
+    const SweepCandidate& b = result.best;
+    cout << std::setprecision(15);
+    cout << "Swept " << result.evaluated << " strategies on " << result.numThreads << " threads in "
+         << seconds << " s (" << result.evaluated / seconds << " strategies/s)\n";
+    cout << "Infeasible: " << result.infeasible << " strategies (W >= CEC or W + B + D > CEC)\n";
+    cout << "Lowest total cost: W=" << b.W << ", R=" << b.R << ", P=" << b.P << ", D=" << b.D
+         << ", B=" << b.B << ", tc=" << b.totalCost << "\n";
+    cout << "Pareto front: " << result.pareto.size() << " strategies\n";
+    cout << "Scratch: " << result.scratchBytes << " bytes over " << result.numThreads << " threads\n";
+    if (columnPath) cout << "Wrote " << result.evaluated << " rows of " << numSweepColumns << " columns to " << columnPath << "\n";
+    if (flags.resume) cout << "Resumed from " << flags.path << " after " << progress.state.evaluated << " strategies\n";
+    if (flags.path) cout << "Checkpoint: " << flags.path << "\n";
+    return 0;
+}
+
+// --adaptive [tolerance] [sequences] [threads] [step]: sweep the lever grid against sequences
+// (default 1000) generated surge sequences, scoring every sequence and then with adaptive
+// stopping at the given relative tolerance (default 0.01), and compare the two
+int RunAdaptive(int argc, char ** argv) {
+    AdaptiveStopping adaptive;
+    adaptive.relativeTolerance = (argc > 2) ? atof(argv[2]) : 0.01;
+    int nS = (argc > 3) ? atoi(argv[3]) : 1000;
+    int numThreads = (argc > 4) ? atoi(argv[4]) : 0;
+    double step = (argc > 5) ? atof(argv[5]) : 4.0;
+    int nHeight = (int)floor(CEC / step + 1e-9) + 1;
+    SweepGrid grid = {{0, step, nHeight}, {0, step, nHeight}, {0, 0.1, 11}, {0, step, nHeight}, {0, step, nHeight}};
+    SurgeGenerator gen = {2019, eadSurges.loc, eadSurges.scale, eadSurges.shape};
+    vector<double> surge((size_t)nS * lengthSurgeSequences);
+    GenerateSurgesParallel(&gen, 0, surge.data(), nS, lengthSurgeSequences, yearMajor,
+                           numThreads > 0 ? numThreads : std::max(1u, std::thread::hardware_concurrency()));
+    SurgeBlock block = {surge.data(), NULL, nS, lengthSurgeSequences, yearMajor};
+    cout << std::setprecision(15);
+    for (const AdaptiveStopping * mode : {(const AdaptiveStopping *)NULL, (const AdaptiveStopping *)&adaptive}) {
+        auto start = std::chrono::steady_clock::now();
+        SweepResult result = SweepStrategies(grid, &block, numThreads, ParetoEpsilon(), NULL, false, mode);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        const SweepCandidate& b = result.best;
+        int64_t feasible = result.evaluated - result.infeasible;
+        cout << (mode ? "Adaptive: " : "Full: ") << feasible << " feasible strategies of " << result.evaluated << ", "
+             << result.sequencesScored << " sequences scored (" << (double)result.sequencesScored / feasible
+             << " per strategy, " << result.deduplicated << " strategies deduplicated) in " << seconds << " s\n";
+        cout << "  Lowest total cost: W=" << b.W << ", R=" << b.R << ", P=" << b.P << ", D=" << b.D
+             << ", B=" << b.B << ", tc=" << b.totalCost << " from " << b.sequences << " sequences\n";
+    }
+    return 0;
+}
+
+// --optimise [generations] [threads] [sequences]: minimize total cost over the policy fractions
+// against sequences (default 500) generated surge sequences of lengthSurgeSequences years, with
+// dike failures drawn from common random numbers
+int RunOptimise(int argc, char ** argv) {
+    CheckpointFlags flags;
+    argc = TakeCheckpointFlags(argc, argv, &flags);
+    if (flags.resume && !flags.path) return 1;
+    int generations = (argc > 2) ? atoi(argv[2]) : 100;
+    int numThreads = (argc > 3) ? atoi(argv[3]) : 0;
+    int nS = (argc > 4) ? atoi(argv[4]) : 500;
+    SurgeGenerator gen = {2019, eadSurges.loc, eadSurges.scale, eadSurges.shape};
+    vector<double> surge((size_t)nS * lengthSurgeSequences);
+    GenerateSurgesParallel(&gen, 0, surge.data(), nS, lengthSurgeSequences, yearMajor,
+                           numThreads > 0 ? numThreads : std::max(1u, std::thread::hardware_concurrency()));
+    SurgeBlock block = {surge.data(), NULL, nS, lengthSurgeSequences, yearMajor};
+    OptimiserOptions options = {1, 0, generations, 0.3, 1e-6, numThreads, flags.path,
+                                flags.interval > 0 ? (int)flags.interval : 10};
+    OptimiserState state;
+    if (flags.resume) {
+        if (!LoadOptimiserCheckpoint(flags.path, &block, &gen, 0, options, &state)) return 1;
+        options.resume = &state;
+    }
+    auto start = std::chrono::steady_clock::now();
+    OptimiserResult result = OptimiseStrategy(&block, &gen, 0, options);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (!result.scored || !result.checkpointed) return 1;
+    const SweepCandidate& b = result.best;
+    cout << std::setprecision(15);
+    cout << "Evaluated " << result.evaluations << " strategies in " << result.generations << " generations in "
+         << seconds << " s (" << result.evaluations / seconds << " strategies/s)\n";
+    cout << "Lowest total cost: W=" << b.W << ", R=" << b.R << ", P=" << b.P << ", D=" << b.D
+         << ", B=" << b.B << ", tc=" << b.totalCost << "\n";
+    cout << "Investment: " << b.tic << ", mean damage: " << b.damage << ", breach frequency: " << b.breachFrequency << "\n";
+    return 0;
+}
+
+// --sampling [events]: expected annual damage of the test cases from every sampling mode, with
+// standard errors, against quadrature over the sampled range. efficiency is the plain variance
+// over the mode's variance: how many times fewer events the mode needs for the same error
+int RunSampling(int argc, char ** argv, const vector<TestCase>& test_cases) {
+    int64_t events = (argc > 2) ? atoll(argv[2]) : 24000;
+    EadRange range = SampledSurgeRange(eadSurges);
+    vector<SurgeSample> samples(numSamplingModes);
+    for (int mode = 0; mode < numSamplingModes; mode++)
+        if (!MakeSurgeSample(&eadSurges, DefaultSamplingOptions(mode, events, 1), &samples[mode])) return 1;
+    cout << std::setprecision(6);
+    cout << "# test_case mode events damage damage_error quadrature efficiency threshold_probability threshold_error\n";
+    for (const auto& tc : test_cases) {
+        double cityChar[27];
+        memset(cityChar, 0, sizeof(cityChar));
+        CharacterizeCity(tc.W, tc.B, tc.R, tc.P, tc.D, cityChar);
+        double ead = ExpectedAnnualDamageDirect(cityChar, range, 1e-10);
+        double plainVariance = 0;
+        for (int mode = 0; mode < numSamplingModes; mode++) {
+            DamageEstimate e = EstimateDamage(cityChar, samples[mode]);
+            double variance = e.damageError * e.damageError * e.events;   // per event, for unequal event counts
+            if (mode == plainSampling) plainVariance = variance;
+            cout << tc.name << " " << samplingModeNames[mode] << " " << e.events << " " << e.damage << " "
+                 << e.damageError << " " << ead << " " << (variance > 0 ? plainVariance / variance : 0.0) << " "
+                 << e.thresholdProbability << " " << e.thresholdError << "\n";
+        }
+    }
+    return 0;
+}
+
+// icow_benchmark.cpp includes this file for the kernels and brings its own main
+#ifndef ICOW_NO_MAIN
+int main(int argc, char ** argv) {
+    if (argc > 1 && strcmp(argv[1], "--sweep") == 0) return RunSweep(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--optimise") == 0) return RunOptimise(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--adaptive") == 0) return RunAdaptive(argc, argv);
+    bool writeColumns = (argc > 1 && strcmp(argv[1], "--columns") == 0);
+
+
+    vector<TestCase> test_cases = ReferenceTestCases();
+    if (argc > 1 && strcmp(argv[1], "--float-error") == 0) return RunFloatError(argc, argv, test_cases);
+    if (argc > 1 && strcmp(argv[1], "--sampling") == 0) return RunSampling(argc, argv, test_cases);
+
+    // Open output files
+    ofstream costs_out("outputs/costs.txt");
+    ofstream zones_out("outputs/zones.txt");
+    ofstream summary_out("outputs/summary.txt");
+    ofstream damage_out("outputs/damage.txt");
+    ofstream ead_out("outputs/ead.txt");
+
+    // Set high precision for outputs
+    costs_out << std::setprecision(15);
+    zones_out << std::setprecision(15);
+    summary_out << std::setprecision(15);
+    damage_out << std::setprecision(15);
+    ead_out << std::setprecision(15);
+    EadZoneCache eadCache = MakeEadZoneCache(eadSurges, 1e-10);
+
+    // Write summary header
+    summary_out << "# ICOW C++ Reference Outputs (Debugged Version)\n";
+    summary_out << "# Generated from debugged C++ code with 8 bug fixes applied\n";
+    summary_out << "# See header of icow_debugged.cpp and _background/equations.md for full details\n";
+    summary_out << "# Bug Fix 5: CitySlope = CEC/CityLength (terrain grade)\n";
+    summary_out << "# Bug Fix 8: Don't set rh=0 when B<minHeight (allows resistance-only)\n\n";
+
+    // Process each test case
+    for (const auto& tc : test_cases) {
+        double cityChar[27];
+        memset(cityChar, 0, sizeof(cityChar));
+
+        // Call CharacterizeCity to compute all costs and zone values
+        CharacterizeCity(tc.W, tc.B, tc.R, tc.P, tc.D, cityChar);
+
+        // === Write costs output ===
+        costs_out << "# Test Case: " << tc.name << "\n";
+        costs_out << "# Levers: W=" << tc.W << ", R=" << tc.R << ", P=" << tc.P
+                  << ", D=" << tc.D << ", B=" << tc.B << "\n";
+        costs_out << "withdrawal_cost: " << cityChar[22] << "\n";  // wc
+        costs_out << "value_after_withdrawal: " << cityChar[17] << "\n";  // tcvaw
+        costs_out << "resistance_cost: " << cityChar[23] << "\n";  // rc
+        costs_out << "dike_cost: " << cityChar[21] << "\n";  // dc
+        costs_out << "total_investment_cost: " << cityChar[24] << "\n\n";  // tic
+
+        // === Write zone geometry output ===
+        zones_out << "# Test Case: " << tc.name << "\n";
+        zones_out << "# Levers: W=" << tc.W << ", R=" << tc.R << ", P=" << tc.P
+                  << ", D=" << tc.D << ", B=" << tc.B << "\n";
+        zones_out << "case_number: " << (int)cityChar[0] << "\n";  // caseNum
+        zones_out << "zone1_value: " << cityChar[6] << "\n";  // vz1
+        zones_out << "zone2_value: " << cityChar[7] << "\n";  // vz2
+        zones_out << "zone3_value: " << cityChar[8] << "\n";  // vz3
+        zones_out << "zone4_value: " << cityChar[9] << "\n";  // vz4
+        zones_out << "zone1_top: " << cityChar[10] << "\n";  // tz1
+        zones_out << "zone2_top: " << cityChar[11] << "\n";  // tz2
+        zones_out << "zone3_top: " << cityChar[12] << "\n";  // tz3
+        zones_out << "zone4_top: " << cityChar[13] << "\n\n";  // tz4
+
+        // === Write event damage output ===
+        double intact[dvLength], failed[dvLength];
+        CalculateDamage(cityChar, tc.h_surge, 0, intact);
+        CalculateDamage(cityChar, tc.h_surge, 1, failed);
+        damage_out << "# Test Case: " << tc.name << "\n";
+        damage_out << "# Levers: W=" << tc.W << ", R=" << tc.R << ", P=" << tc.P
+                   << ", D=" << tc.D << ", B=" << tc.B << "\n";
+        damage_out << "h_surge: " << tc.h_surge << "\n";
+        damage_out << "effective_surge: " << EffectiveSurge(tc.h_surge) << "\n";
+        damage_out << "damage_intact: " << intact[dvt] << "\n";
+        damage_out << "damage_failed: " << failed[dvt] << "\n";
+        damage_out << "dike_failure_probability: "
+                   << DikeFailureProbability(SurgeAtDike(cityChar, tc.h_surge), cityChar[dh]) << "\n\n";
+
+        // === Write expected annual damage output ===
+        ead_out << "# Test Case: " << tc.name << "\n";
+        ead_out << "# Levers: W=" << tc.W << ", R=" << tc.R << ", P=" << tc.P
+                << ", D=" << tc.D << ", B=" << tc.B << "\n";
+        ead_out << "surge_loc: " << eadSurges.loc << "\n";
+        ead_out << "surge_scale: " << eadSurges.scale << "\n";
+        ead_out << "surge_shape: " << eadSurges.shape << "\n";
+        ead_out << "expected_annual_damage: " << ExpectedAnnualDamage(cityChar, &eadCache) << "\n\n";
+    }
+
+    costs_out.close();
+    zones_out.close();
+    summary_out.close();
+    damage_out.close();
+    ead_out.close();
+
+    // The batched interfaces must reproduce the scalar results exactly
+    LeverColumns levers = ConsistencyLevers(test_cases);
+    if (!BatchMatchesScalar(CharacterizeCityBatch, levers) ||
+        !BatchMatchesScalar(CharacterizeCityBatchBranchFree, levers) ||
+        !BatchMatchesScalar(CharacterizeCityBatchDefaultRuntimeCity, levers) ||
+        !BatchMatchesScalar(CharacterizeCityBatchCachedDikeCost, levers) ||
+        !StagedMatchesScalar(levers) ||
+        !ResistanceFractionMatches() ||
+        !GradientMatchesFiniteDifferences(levers) ||
+        !FloatModeAccurate(test_cases) ||
+        !DikeCostPathsMatch() ||
+        !DamageBlockMatchesScalar(test_cases) ||
+        !SurgeBlockLayoutsMatch(test_cases) ||
+        !SweepMatchesSerial() ||
+        !DeduplicationMatches() ||
+        !ColumnFileRoundTrip() ||
+        !SurgeFileMatchesMemory(test_cases) ||
+        !CAbiMatchesKernels(test_cases) ||
+        !AdaptiveStoppingMatches() ||
+        !CheckpointResumeMatches() ||
+        !SurgeGeneratorReproducible() ||
+        !DikeFailureSamplesMatch(test_cases) ||
+        !EvaluationArenaMatches(test_cases) ||
+        !DynamicMatchesYearly() ||
+        !OptimiserFindsGridOptimum() ||
+        !ExpectedDamageMatchesDirect(test_cases) ||
+        !SamplingMatchesQuadrature(test_cases)) {
+        return 1;
+    }
+    if (writeColumns && !WriteTestCaseColumns(test_cases)) return 1;
+
+    cout << "Test outputs generated successfully in outputs/ directory!\n";
+    cout << "Files created:\n";
+    cout << "  - outputs/costs.txt\n";
+    cout << "  - outputs/zones.txt\n";
+    cout << "  - outputs/summary.txt\n";
+    cout << "  - outputs/damage.txt\n";
+    cout << "  - outputs/ead.txt\n";
+    if (writeColumns) {
+        cout << "  - outputs/city.col\n";
+        cout << "  - outputs/damage.col\n";
+    }
 
     return 0;
 }
+#endif // ICOW_NO_MAIN
@@ -0,0 +1,319 @@
+// Scaling benchmark of the ICOW pipeline
+//
+// Builds the kernels of icow_debugged.cpp without its main and times whole runs rather than
+// single kernels: the surge-scored grid sweep (SweepStrategies) and the threaded cost
+// characterization of a grid, over thread counts 1..N. Each configuration reports strategies/s,
+// the parallel efficiency against one thread, and a modelled memory traffic as a share of the
+// bandwidth a triad reaches on the same number of threads. Results go to stdout as CSV, and
+// optionally to CSV and JSON files.
+//
+// Usage: ./icow_scaling [--max-threads n] [--reps n] [--csv path] [--json path]
+
+#define ICOW_NO_MAIN
+#include "icow_debugged.cpp"
+
+// one timed configuration. threads varies fastest within a configuration, so parallel
+// efficiency is against the preceding threads == 1 row.
+struct ScalingResult {
+    string pipeline;        // "sweep" or "characterize"
+    string precision;       // "double" or "float"
+    string layout;          // sweep: surge block layout; characterize: "soa" batch or "aos" rows
+    int threads;
+    int64_t strategies;
+    int sequences;          // surge sequences per block, 0 for characterize
+    int years;              // years per sequence, 0 for characterize
+    int64_t infeasible;     // sweep strategies failing StrategyFeasible, never scored
+    int64_t deduplicated;   // sweep strategies that took a cached score (last rep)
+    double seconds = 0;         // median over the reps
+    double strategiesPerSecond = 0;
+    double bytesPerSecond = 0;  // modelled traffic (see ModelledBytes) over seconds
+    double bandwidthShare = 0;  // bytesPerSecond over the triad bandwidth at this thread count
+    double efficiency = 0;      // strategiesPerSecond / (threads * strategiesPerSecond at 1 thread)
+};
+
+// results are folded into this so no run is optimized away
+volatile double scalingSink = 0;
+
+double MedianSeconds(vector<double> v) {
+    std::sort(v.begin(), v.end());
+    return v[v.size() / 2];
+}
+
+template <class F>
+double TimeRun(int reps, F run) {
+    vector<double> seconds;
+    for (int r = 0; r < reps; r++) {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        seconds.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return MedianSeconds(seconds);
+}
+
+// run body(t, begin, end) on numThreads threads, each over a contiguous share of [0, n)
+template <class F>
+void RunThreaded(int numThreads, int64_t n, F body) {
+    vector<std::thread> threads;
+    for (int t = 1; t < numThreads; t++) threads.emplace_back(body, t, n * t / numThreads, n * (t + 1) / numThreads);
+    body(0, 0, n / numThreads);
+    for (auto& th : threads) th.join();
+}
+
+// 1, 2, 4, ... below maxThreads, then maxThreads
+vector<int> ThreadCounts(int maxThreads) {
+    vector<int> counts;
+    for (int t = 1; t < maxThreads; t *= 2) counts.push_back(t);
+    counts.push_back(maxThreads);
+    return counts;
+}
+
+// STREAM triad a = b + s*c over arrays of four times the last level cache in total (at least
+// 192 MiB), in bytes/s: the best of reps, counting 24 bytes per element
+double TriadBandwidth(int numThreads, int reps) {
+    int64_t llc = 0;
+#ifdef _SC_LEVEL3_CACHE_SIZE
+    llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+#endif
+    static vector<double> a, b, c;
+    int64_t n = std::max<int64_t>(1 << 23, 4 * llc / 24);
+    if ((int64_t)a.size() != n) {
+        a.assign(n, 0);
+        b.assign(n, 1);
+        c.assign(n, 2);
+    }
+    double best = INFINITY;
+    for (int r = 0; r < reps + 1; r++) {   // the first pass only faults the pages in
+        auto start = std::chrono::steady_clock::now();
+        RunThreaded(numThreads, n, [&](int, int64_t begin, int64_t end) {
+            double * pa = a.data();
+            const double * pb = b.data(), * pc = c.data();
+            #pragma omp simd
+            for (int64_t i = begin; i < end; i++) pa[i] = pb[i] + 3.0 * pc[i];
+        });
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (r > 0) best = std::min(best, seconds);
+        scalingSink = scalingSink + a[n / 2];
+    }
+    return 24.0 * n / best;
+}
+
+// Modelled bytes per strategy. A scored strategy streams the whole surge block and its breach
+// mask; characterization reads five levers and writes its outputs (13 columns and the case in
+// the batch, a 27-entry cityChar row otherwise). Near 100% of the triad a run is DRAM-bound;
+// above it, the data is served from cache.
+double ModelledBytes(const ScalingResult& r) {
+    if (r.pipeline == "sweep") return (double)r.sequences * r.years * (sizeof(double) + 1.0 / 8);
+    double value = (r.precision == "float") ? sizeof(float) : sizeof(double);
+    if (r.layout == "aos") return 5 * value + numCityChar * value;
+    return 5 * value + 13 * value + sizeof(int);
+}
+
+SweepGrid ScalingGrid(double step) {
+    int nHeight = (int)floor(CEC / step + 1e-9) + 1;
+    SweepGrid grid = {{0, step, nHeight}, {0, step, nHeight}, {0, 0.1, 11}, {0, step, nHeight}, {0, step, nHeight}};
+    return grid;
+}
+
+// the grid's levers as columns, in grid index order
+LeverColumns GridLevers(const SweepGrid& grid) {
+    LeverColumns lv;
+    for (int64_t index = 0; index < grid.Size(); index++) {
+        int64_t k = index;
+        lv.B.push_back(grid.B.Value(k % grid.B.count)); k /= grid.B.count;
+        lv.D.push_back(grid.D.Value(k % grid.D.count)); k /= grid.D.count;
+        lv.P.push_back(grid.P.Value(k % grid.P.count)); k /= grid.P.count;
+        lv.R.push_back(grid.R.Value(k % grid.R.count)); k /= grid.R.count;
+        lv.W.push_back(grid.W.Value(k));
+    }
+    return lv;
+}
+
+// Only strategies that read the surge block are charged its bytes: infeasible ones are never
+// scored and deduplicated ones take a cached score. strategiesPerSecond counts the whole grid.
+void FinishResult(ScalingResult& r, double triad, double singleThread) {
+    r.strategiesPerSecond = r.strategies / r.seconds;
+    r.bytesPerSecond = ModelledBytes(r) * (r.strategies - r.infeasible - r.deduplicated) / r.seconds;
+    r.bandwidthShare = r.bytesPerSecond / triad;
+    r.efficiency = r.strategiesPerSecond / (r.threads * singleThread);
+}
+
+// Sweep the grid against a generated block of sequences x years in the given layout
+void RunSweepScaling(const vector<int>& threadCounts, const vector<double>& triad, int reps, double step,
+                     int sequences, int years, int layout, vector<ScalingResult>& results) {
+    SweepGrid grid = ScalingGrid(step);
+    SurgeGenerator gen = {2019, eadSurges.loc, eadSurges.scale, eadSurges.shape};
+    vector<double> surge((size_t)sequences * years);
+    GenerateSurgesParallel(&gen, 0, surge.data(), sequences, years, layout, threadCounts.back());
+    SurgeBlock block = {surge.data(), NULL, sequences, years, layout};
+    vector<uint64_t> mask((size_t)SurgeRowWords(&block) * (layout == yearMajor ? years : sequences));
+    double cityChar[numCityChar];
+    memset(cityChar, 0, sizeof(cityChar));
+    CharacterizeCity(2, 1, 3, 0.8, 5, cityChar);
+    SampleDikeFailures(cityChar, &gen, 0, &block, mask.data());
+    block.breachMask = mask.data();
+    double singleThread = 0;
+    for (size_t k = 0; k < threadCounts.size(); k++) {
+        ScalingResult r = {"sweep", "double", layout == yearMajor ? "yearMajor" : "sequenceMajor", threadCounts[k],
+                           grid.Size(), sequences, years, 0, 0};
+        r.seconds = TimeRun(reps, [&]() {
+            SweepResult s = SweepStrategies(grid, &block, r.threads);
+            scalingSink = scalingSink + s.best.totalCost;
+            r.infeasible = s.infeasible;
+            r.deduplicated = s.deduplicated;
+        });
+        if (k == 0) singleThread = r.strategies / r.seconds;
+        FinishResult(r, triad[k], singleThread);
+        results.push_back(r);
+    }
+}
+
+// Characterize every strategy of the grid into full-size outputs: the double or float batch
+// (soa) or CharacterizeCity rows (aos), each thread over a contiguous share of the grid
+void RunCharacterizeScaling(const vector<int>& threadCounts, const vector<double>& triad, int reps, double step,
+                            vector<ScalingResult>& results) {
+    SweepGrid grid = ScalingGrid(step);
+    int64_t n = grid.Size();
+    LeverColumns lv = GridLevers(grid);
+    vector<float> f[5];
+    const vector<double> * in[5] = {&lv.W, &lv.B, &lv.R, &lv.P, &lv.D};
+    for (int k = 0; k < 5; k++) f[k].assign(in[k]->begin(), in[k]->end());
+    vector<int> caseCol(n);
+    for (const char * mode : {"double soa", "float soa", "double aos"}) {
+        bool isFloat = (strcmp(mode, "float soa") == 0), isRows = (strcmp(mode, "double aos") == 0);
+        vector<double> out(isFloat ? 0 : (size_t)(isRows ? numCityChar : 13) * n);
+        vector<float> outFloat(isFloat ? (size_t)13 * n : 0);
+        auto body = [&](int, int64_t begin, int64_t end) {
+            int64_t m = end - begin;
+            if (isRows) {
+                for (int64_t i = begin; i < end; i++) {
+                    double * row = &out[(size_t)i * numCityChar];
+                    memset(row, 0, numCityChar * sizeof(double));
+                    CharacterizeCity(lv.W[i], lv.B[i], lv.R[i], lv.P[i], lv.D[i], row);
+                }
+            } else if (isFloat) {
+                // column k of the thread's share at outFloat[k*n + begin]
+                float * q = outFloat.data() + begin;
+                CityColumnsFloat c = {caseCol.data() + begin, q, q + n, q + 2*n, q + 3*n, q + 4*n, q + 5*n, q + 6*n,
+                                      q + 7*n, q + 8*n, q + 9*n, q + 10*n, q + 11*n, q + 12*n};
+                CharacterizeCityBatchFloat(m, f[0].data() + begin, f[1].data() + begin, f[2].data() + begin,
+                                           f[3].data() + begin, f[4].data() + begin, c);
+            } else {
+                double * o = out.data() + begin;
+                CityColumns c = {caseCol.data() + begin, o, o + n, o + 2*n, o + 3*n, o + 4*n, o + 5*n, o + 6*n,
+                                 o + 7*n, o + 8*n, o + 9*n, o + 10*n, o + 11*n, o + 12*n};
+                CharacterizeCityBatchBranchFree(m, lv.W.data() + begin, lv.B.data() + begin, lv.R.data() + begin,
+                                                lv.P.data() + begin, lv.D.data() + begin, c);
+            }
+        };
+        double singleThread = 0;
+        for (size_t k = 0; k < threadCounts.size(); k++) {
+            ScalingResult r = {"characterize", isFloat ? "float" : "double", isRows ? "aos" : "soa", threadCounts[k], n, 0, 0, 0, 0};
+            RunThreaded(r.threads, n, body);   // faults the outputs in
+            r.seconds = TimeRun(reps, [&]() { RunThreaded(r.threads, n, body); });
+            scalingSink = scalingSink + caseCol[n / 2];
+            if (k == 0) singleThread = r.strategies / r.seconds;
+            FinishResult(r, triad[k], singleThread);
+            results.push_back(r);
+        }
+    }
+}
+
+const char * const scalingCsvHeader =
+    "pipeline,precision,layout,threads,strategies,sequences,years,infeasible,deduplicated,seconds,strategies_per_sec,"
+    "modelled_bytes_per_sec,bandwidth_share,parallel_efficiency";
+
+void WriteScalingCsvRow(ostream& out, const ScalingResult& r) {
+    out << r.pipeline << "," << r.precision << "," << r.layout << "," << r.threads << "," << r.strategies << ","
+        << r.sequences << "," << r.years << "," << r.infeasible << "," << r.deduplicated << "," << r.seconds << "," << r.strategiesPerSecond << ","
+        << r.bytesPerSecond << "," << r.bandwidthShare << "," << r.efficiency << "\n";
+}
+
+void WriteScalingJson(ostream& out, const vector<ScalingResult>& results, const vector<int>& threadCounts,
+                      const vector<double>& triad, int reps) {
+    out << std::setprecision(6);
+    out << "{\n";
+    out << "  \"suite\": \"icow_scaling\",\n";
+    out << "  \"compiler\": \"" << __VERSION__ << "\",\n";
+    out << "  \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n";
+    out << "  \"reps\": " << reps << ",\n";
+    out << "  \"triad\": [";
+    for (size_t k = 0; k < threadCounts.size(); k++)
+        out << (k ? ", " : "") << "{\"threads\": " << threadCounts[k] << ", \"bytes_per_sec\": " << triad[k] << "}";
+    out << "],\n";
+    out << "  \"results\": [\n";
+    for (size_t k = 0; k < results.size(); k++) {
+        const ScalingResult& r = results[k];
+        out << "    {\"pipeline\": \"" << r.pipeline << "\", \"precision\": \"" << r.precision << "\", \"layout\": \""
+            << r.layout << "\", \"threads\": " << r.threads << ", \"strategies\": " << r.strategies
+            << ", \"sequences\": " << r.sequences << ", \"years\": " << r.years << ", \"infeasible\": " << r.infeasible
+            << ", \"deduplicated\": " << r.deduplicated << ", \"seconds\": " << r.seconds
+            << ", \"strategies_per_sec\": " << r.strategiesPerSecond << ", \"modelled_bytes_per_sec\": " << r.bytesPerSecond
+            << ", \"bandwidth_share\": " << r.bandwidthShare << ", \"parallel_efficiency\": " << r.efficiency << "}"
+            << (k + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n";
+    out << "}\n";
+}
+
+int main(int argc, char ** argv) {
+    const char * csvPath = NULL;
+    const char * jsonPath = NULL;
+    int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    int reps = 3;
+    for (int a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "--csv") == 0 && a + 1 < argc) csvPath = argv[++a];
+        else if (strcmp(argv[a], "--json") == 0 && a + 1 < argc) jsonPath = argv[++a];
+        else if (strcmp(argv[a], "--max-threads") == 0 && a + 1 < argc) maxThreads = std::max(1, atoi(argv[++a]));
+        else if (strcmp(argv[a], "--reps") == 0 && a + 1 < argc) reps = std::max(1, atoi(argv[++a]));
+        else {
+            cerr << "Usage: " << argv[0] << " [--max-threads n] [--reps n] [--csv path] [--json path]\n";
+            return 1;
+        }
+    }
+    vector<int> threadCounts = ThreadCounts(maxThreads);
+    vector<double> triad;
+    for (int t : threadCounts) triad.push_back(TriadBandwidth(t, reps));
+
+    // The sweep varies one factor at a time around 1000 sequences of lengthSurgeSequences years,
+    // year-major, on the 8 m grid (891 strategies): block size up to maxSurgeBlock, sequence
+    // length, layout and grid size (4 values per height, 2816 strategies). maxSurgeBlock and lengthSurgeSequences are compile-time
+    // defaults; the pipeline takes any block shape, so the benchmark varies the block instead.
+    vector<ScalingResult> results;
+    const int baseSequences = 1000, baseYears = lengthSurgeSequences;
+    RunSweepScaling(threadCounts, triad, reps, 8, baseSequences, baseYears, yearMajor, results);
+    RunSweepScaling(threadCounts, triad, reps, 8, 250, baseYears, yearMajor, results);
+    RunSweepScaling(threadCounts, triad, reps, 8, maxSurgeBlock, baseYears, yearMajor, results);
+    RunSweepScaling(threadCounts, triad, reps, 8, baseSequences, baseYears / 4, yearMajor, results);
+    RunSweepScaling(threadCounts, triad, reps, 8, baseSequences, 2 * baseYears, yearMajor, results);
+    RunSweepScaling(threadCounts, triad, reps, 8, baseSequences, baseYears, sequenceMajor, results);
+    RunSweepScaling(threadCounts, triad, reps, CEC / 3, baseSequences, baseYears, yearMajor, results);
+    // characterization of the 2 m (72171) and 1 m (1.15 million strategies) grids
+    RunCharacterizeScaling(threadCounts, triad, reps, 2, results);
+    RunCharacterizeScaling(threadCounts, triad, reps, 1, results);
+
+    cout << std::setprecision(4);
+    cout << "# triad bytes/s:";
+    for (size_t k = 0; k < threadCounts.size(); k++) cout << " " << threadCounts[k] << " threads " << triad[k];
+    cout << "\n" << scalingCsvHeader << "\n";
+    for (const ScalingResult& r : results) WriteScalingCsvRow(cout, r);
+    if (csvPath) {
+        ofstream csv(csvPath);
+        csv << std::setprecision(6) << scalingCsvHeader << "\n";
+        for (const ScalingResult& r : results) WriteScalingCsvRow(csv, r);
+        if (!csv) {
+            cerr << "Cannot write " << csvPath << "\n";
+            return 1;
+        }
+        cout << "Wrote " << csvPath << "\n";
+    }
+    if (jsonPath) {
+        ofstream json(jsonPath);
+        WriteScalingJson(json, results, threadCounts, triad, reps);
+        if (!json) {
+            cerr << "Cannot write " << jsonPath << "\n";
+            return 1;
+        }
+        cout << "Wrote " << jsonPath << "\n";
+    }
+    return 0;
+}